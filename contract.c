@@ -0,0 +1,785 @@
+/*----------------------------------------------------
+ * File:    contract.c
+ *
+ * Purpose: contraction hierarchy for many point to point queries on a
+ *          static graph: build it once from the graph mpi_Dijkstra reads
+ *          and save it as an index, then answer s-t queries from the
+ *          index with a bidirectional search that only goes upwards
+ *
+ * Compile: gcc -O2 -Wall -o contract contract.c
+ * Run:     ./contract [-o graph.ch] < matrix.txt
+ *          ./contract [-o graph.ch] -bin matrix.bin
+ *          ./contract [-o graph.ch] -edges graph.txt
+ *          ./contract -query graph.ch [s t ...] [< pairs.txt]
+ *
+ * Input:   the three graph formats of mpi_Dijkstra: the dense matrix on
+ *          stdin (n, then n rows, INFINITY = no edge), the DJKM binary
+ *          matrix or a "src dst weight" edge list.  Weights are integers.
+ *          Queries are s t pairs on the command line, else read from
+ *          stdin.
+ *
+ * Output:  build: graph.ch (default) and the number of shortcuts and time.
+ *          query: for each pair "dist s->t: D" and "Path s->t: ...", then
+ *          the mean time and vertices settled per query.
+ *
+ * Algorithm: vertices are contracted one at a time in the order of a
+ *          lazily updated priority, the edge difference (shortcuts
+ *          added - arcs removed) plus the number of neighbours already
+ *          contracted.  Contracting v adds a shortcut u->w of weight
+ *          d(u,v) + d(v,w) for each pair of uncontracted in- and
+ *          out-neighbours unless a witness search from u, which avoids v
+ *          and settles at most WITNESS_SETTLE vertices, finds a path
+ *          that is no longer.  The rank of v is its place in the order.
+ *          The arcs v has when it is contracted all lead to higher ranks:
+ *          its out-arcs form the upward graph of the forward search and
+ *          its in-arcs, reversed, the one of the backward search.  Every
+ *          shortest path has a version that goes up and then down, so the
+ *          two searches meet on it; a direction stops when its smallest
+ *          key is no better than the best s-t distance found.  A shortcut
+ *          remembers the contracted vertex it skips, which is how the
+ *          path is unpacked.
+ *
+ *          Index file: the 4 bytes "DJCH", the weight size (8), n, the
+ *          number of up and down arcs as int64, then rank[n] (int32),
+ *          the n + 1 offsets of the up arcs and of the down arcs (int64)
+ *          and the arcs as (vertex, skipped vertex or -1, weight).
+ *--------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#define INFINITY 1000000
+#define BIN_MAGIC "DJKM"
+#define BIN_HEADER_SIZE 16
+#define CH_MAGIC "DJCH"
+#define CH_HEADER_SIZE 32
+#define CH_FILE "graph.ch"
+#define CH_INF LLONG_MAX
+#define WITNESS_SETTLE 500
+
+/* arc to v, mid is the vertex a shortcut skips, -1 for an edge */
+typedef struct
+{
+    int v, mid;
+    long long w;
+} Arc;
+
+typedef struct
+{
+    Arc *a;
+    int len, cap;
+} Arc_list;
+
+/* binary min-heap of (key, vertex), stale entries are skipped by the
+ * caller */
+typedef struct
+{
+    long long key;
+    int v;
+} Heap_item;
+
+typedef struct
+{
+    Heap_item *a;
+    int size, cap;
+} Heap;
+
+/* graph being contracted: out[u] and in[w] both hold the arc u->w */
+typedef struct
+{
+    int n;
+    Arc_list *out, *in;
+    char *contracted;
+    int *deleted; /* contracted neighbours */
+    long long *wit_dist;
+    int *touched, n_touched;
+    Heap heap;
+} Ch_graph;
+
+/* the index: up arcs of u lead to higher ranks, down arcs of u come from
+ * higher ranks (arc x->u stored as x) */
+typedef struct
+{
+    int n;
+    int *rank;
+    long long *up_off, *down_off;
+    Arc *up, *down;
+} Ch_index;
+
+double Now(void);
+void Heap_push(Heap *h, long long key, int v);
+Heap_item Heap_pop(Heap *h);
+void Add_arc(Ch_graph *g, int u, int v, long long w, int mid);
+int Read_graph(int argc, char *argv[], Ch_graph *g);
+void Witness_search(Ch_graph *g, int src, int skip, long long max_dist);
+int Contract_node(Ch_graph *g, int v, int simulate);
+void Build_index(Ch_graph *g, Ch_index *ch);
+int Write_index(char *path, Ch_index *ch);
+int Read_index(char *path, Ch_index *ch);
+long long Ch_query(Ch_index *ch, int s, int t, int path[], int *len_p, long long *settled_p);
+void Query_index(Ch_index *ch, int argc, char *argv[], int first);
+
+int main(int argc, char *argv[])
+{
+    Ch_graph g;
+    Ch_index ch;
+    char *out_path = CH_FILE;
+    int i;
+    double t;
+
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-query") == 0 && i + 1 < argc)
+        {
+            if (Read_index(argv[i + 1], &ch) != 0)
+            {
+                fprintf(stderr, "Can't read index %s\n", argv[i + 1]);
+                return 1;
+            }
+            Query_index(&ch, argc, argv, i + 2);
+            return 0;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out_path = argv[i + 1];
+
+    t = Now();
+    if (Read_graph(argc, argv, &g) != 0)
+        return 1;
+    printf("read %d vertices in %.3f s\n", g.n, Now() - t);
+
+    t = Now();
+    Build_index(&g, &ch);
+    printf("contracted in %.3f s, %lld up and %lld down arcs\n", Now() - t,
+           ch.up_off[ch.n], ch.down_off[ch.n]);
+    if (Write_index(out_path, &ch) != 0)
+    {
+        fprintf(stderr, "Can't write index %s\n", out_path);
+        return 1;
+    }
+    printf("index written to %s\n", out_path);
+    return 0;
+}
+
+double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void Heap_push(Heap *h, long long key, int v)
+{
+    int i = h->size++, parent;
+
+    if (h->size > h->cap)
+    {
+        h->cap = h->cap ? 2 * h->cap : 64;
+        h->a = realloc(h->a, h->cap * sizeof(Heap_item));
+    }
+    while (i > 0 && h->a[parent = (i - 1) / 2].key > key)
+    {
+        h->a[i] = h->a[parent];
+        i = parent;
+    }
+    h->a[i].key = key;
+    h->a[i].v = v;
+}
+
+Heap_item Heap_pop(Heap *h)
+{
+    Heap_item top = h->a[0], last = h->a[--h->size];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < h->size)
+    {
+        if (child + 1 < h->size && h->a[child + 1].key < h->a[child].key)
+            child++;
+        if (h->a[child].key >= last.key)
+            break;
+        h->a[i] = h->a[child];
+        i = child;
+    }
+    h->a[i] = last;
+    return top;
+}
+
+static void Append_arc(Arc_list *l, int v, long long w, int mid)
+{
+    if (l->len == l->cap)
+    {
+        l->cap = l->cap ? 2 * l->cap : 4;
+        l->a = realloc(l->a, l->cap * sizeof(Arc));
+    }
+    l->a[l->len].v = v;
+    l->a[l->len].mid = mid;
+    l->a[l->len].w = w;
+    l->len++;
+}
+
+/* u->v with weight w, or a lower weight for an existing u->v */
+void Add_arc(Ch_graph *g, int u, int v, long long w, int mid)
+{
+    int i, j;
+
+    for (i = 0; i < g->out[u].len; i++)
+        if (g->out[u].a[i].v == v)
+        {
+            if (w < g->out[u].a[i].w)
+            {
+                g->out[u].a[i].w = w;
+                g->out[u].a[i].mid = mid;
+                for (j = 0; g->in[v].a[j].v != u; j++)
+                    ;
+                g->in[v].a[j].w = w;
+                g->in[v].a[j].mid = mid;
+            }
+            return;
+        }
+    Append_arc(&g->out[u], v, w, mid);
+    Append_arc(&g->in[v], u, w, mid);
+}
+
+static void Init_graph(Ch_graph *g, int n)
+{
+    g->n = n;
+    g->out = calloc(n, sizeof(Arc_list));
+    g->in = calloc(n, sizeof(Arc_list));
+    g->contracted = calloc(n, 1);
+    g->deleted = calloc(n, sizeof(int));
+    g->wit_dist = malloc(n * sizeof(long long));
+    g->touched = malloc(n * sizeof(int));
+    g->n_touched = 0;
+    g->heap.a = NULL;
+    g->heap.size = g->heap.cap = 0;
+    for (int v = 0; v < n; v++)
+        g->wit_dist[v] = CH_INF;
+}
+
+/* The graph from -bin <file>, -edges <file> or the matrix on stdin */
+int Read_graph(int argc, char *argv[], Ch_graph *g)
+{
+    FILE *f;
+    char *bin_file = NULL, *edge_file = NULL, line[256], header[BIN_HEADER_SIZE];
+    long long n = 0, u, v, w, max_v = -1, i, j;
+    int elem_size, *row, got;
+
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-bin") == 0 && i + 1 < argc)
+            bin_file = argv[++i];
+        else if (strcmp(argv[i], "-edges") == 0 && i + 1 < argc)
+            edge_file = argv[++i];
+
+    if (edge_file != NULL)
+    {
+        /* two passes: n, then the edges */
+        if ((f = fopen(edge_file, "r")) == NULL)
+        {
+            fprintf(stderr, "Error opening edge file %s\n", edge_file);
+            return 1;
+        }
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            if (line[0] == '#' || line[0] == '%')
+                continue;
+            got = sscanf(line, "%lld %lld %lld", &u, &v, &w);
+            if (got == 1 && u > n)
+                n = u;
+            else if (got == 3 && (u < 0 || v < 0 || w < 0))
+                fprintf(stderr, "Skipping edge %lld %lld %lld\n", u, v, w);
+            else if (got == 3)
+            {
+                if (u > max_v)
+                    max_v = u;
+                if (v > max_v)
+                    max_v = v;
+            }
+        }
+        if (max_v + 1 > n)
+            n = max_v + 1;
+        if (n > INT_MAX)
+        {
+            fprintf(stderr, "%s has more than INT_MAX vertices\n", edge_file);
+            fclose(f);
+            return 1;
+        }
+        Init_graph(g, n);
+        rewind(f);
+        while (fgets(line, sizeof(line), f) != NULL)
+            if (line[0] != '#' && line[0] != '%' &&
+                sscanf(line, "%lld %lld %lld", &u, &v, &w) == 3 && u != v && u >= 0 &&
+                v >= 0 && w >= 0 && u < n && v < n)
+                Add_arc(g, u, v, w, -1);
+        fclose(f);
+        return 0;
+    }
+
+    if (bin_file != NULL)
+    {
+        if ((f = fopen(bin_file, "rb")) == NULL ||
+            fread(header, 1, BIN_HEADER_SIZE, f) != BIN_HEADER_SIZE)
+        {
+            fprintf(stderr, "Error opening binary file %s\n", bin_file);
+            return 1;
+        }
+        memcpy(&elem_size, header + 4, sizeof(int));
+        memcpy(&n, header + 8, sizeof(long long));
+        if (memcmp(header, BIN_MAGIC, 4) != 0 || elem_size != 4 || n <= 0 || n > INT_MAX)
+        {
+            fprintf(stderr, "%s is not a DJKM int32 matrix\n", bin_file);
+            return 1;
+        }
+    }
+    else
+    {
+        f = stdin;
+        if (scanf("%lld", &n) != 1 || n <= 0 || n > INT_MAX)
+        {
+            fprintf(stderr, "Can't read n\n");
+            return 1;
+        }
+    }
+
+    Init_graph(g, n);
+    row = malloc(n * sizeof(int));
+    for (i = 0; i < n; i++)
+    {
+        if (bin_file != NULL)
+        {
+            if (fread(row, sizeof(int), n, f) != (size_t)n)
+            {
+                fprintf(stderr, "%s is too short\n", bin_file);
+                return 1;
+            }
+        }
+        else
+            for (j = 0; j < n; j++)
+                if (scanf("%d", &row[j]) != 1)
+                {
+                    fprintf(stderr, "Can't read row %lld\n", i);
+                    return 1;
+                }
+        for (j = 0; j < n; j++)
+            if (j != i && row[j] != INFINITY)
+                Add_arc(g, i, j, row[j], -1);
+    }
+    free(row);
+    if (bin_file != NULL)
+        fclose(f);
+    return 0;
+}
+
+/* Distances from src in wit_dist over the uncontracted vertices but
+ * skip, up to max_dist and WITNESS_SETTLE settled vertices */
+void Witness_search(Ch_graph *g, int src, int skip, long long max_dist)
+{
+    Heap_item top;
+    Arc *a;
+    int i, settled = 0;
+
+    while (g->n_touched > 0)
+        g->wit_dist[g->touched[--g->n_touched]] = CH_INF;
+    g->heap.size = 0;
+    g->wit_dist[src] = 0;
+    g->touched[g->n_touched++] = src;
+    Heap_push(&g->heap, 0, src);
+    while (g->heap.size > 0 && settled < WITNESS_SETTLE)
+    {
+        top = Heap_pop(&g->heap);
+        if (top.key > g->wit_dist[top.v])
+            continue;
+        if (top.key > max_dist)
+            break;
+        settled++;
+        for (i = 0; i < g->out[top.v].len; i++)
+        {
+            a = &g->out[top.v].a[i];
+            if (a->v == skip || g->contracted[a->v] || top.key + a->w >= g->wit_dist[a->v])
+                continue;
+            if (g->wit_dist[a->v] == CH_INF)
+                g->touched[g->n_touched++] = a->v;
+            g->wit_dist[a->v] = top.key + a->w;
+            Heap_push(&g->heap, top.key + a->w, a->v);
+        }
+    }
+}
+
+/* The shortcuts contracting v needs; they are only added when simulate
+ * is 0 */
+int Contract_node(Ch_graph *g, int v, int simulate)
+{
+    Arc *in, *out;
+    long long max_out = 0;
+    int i, j, shortcuts = 0;
+
+    for (j = 0; j < g->out[v].len; j++)
+        if (!g->contracted[g->out[v].a[j].v] && g->out[v].a[j].w > max_out)
+            max_out = g->out[v].a[j].w;
+    for (i = 0; i < g->in[v].len; i++)
+    {
+        in = &g->in[v].a[i];
+        if (g->contracted[in->v])
+            continue;
+        Witness_search(g, in->v, v, in->w + max_out);
+        for (j = 0; j < g->out[v].len; j++)
+        {
+            out = &g->out[v].a[j];
+            if (g->contracted[out->v] || out->v == in->v ||
+                g->wit_dist[out->v] <= in->w + out->w)
+                continue;
+            shortcuts++;
+            if (!simulate)
+                Add_arc(g, in->v, out->v, in->w + out->w, v);
+        }
+    }
+    return shortcuts;
+}
+
+static int Priority(Ch_graph *g, int v)
+{
+    int i, removed = 0;
+
+    for (i = 0; i < g->out[v].len; i++)
+        removed += !g->contracted[g->out[v].a[i].v];
+    for (i = 0; i < g->in[v].len; i++)
+        removed += !g->contracted[g->in[v].a[i].v];
+    return Contract_node(g, v, 1) - removed + g->deleted[v];
+}
+
+/* Contracts every vertex of g and keeps the upward arcs in ch */
+void Build_index(Ch_graph *g, Ch_index *ch)
+{
+    Heap order = {NULL, 0, 0};
+    Heap_item top;
+    long long n_up = 0, n_down = 0, cap_up = 1024, cap_down = 1024, prio;
+    int n = g->n, v, i, next = 0;
+    Arc *a;
+
+    ch->n = n;
+    ch->rank = malloc(n * sizeof(int));
+    ch->up_off = malloc((n + 1) * sizeof(long long));
+    ch->down_off = malloc((n + 1) * sizeof(long long));
+    ch->up = malloc(cap_up * sizeof(Arc));
+    ch->down = malloc(cap_down * sizeof(Arc));
+
+    for (v = 0; v < n; v++)
+        Heap_push(&order, Priority(g, v), v);
+
+    /* the arcs of each vertex go to the index when it is contracted, in
+     * contraction order; offsets are per vertex, so keep them by rank
+     * first and reorder at the end */
+    while (order.size > 0)
+    {
+        top = Heap_pop(&order);
+        v = top.v;
+        prio = Priority(g, v);
+        if (order.size > 0 && prio > order.a[0].key)
+        {
+            Heap_push(&order, prio, v);
+            continue;
+        }
+
+        ch->rank[v] = next;
+        ch->up_off[next] = n_up;
+        ch->down_off[next] = n_down;
+        next++;
+        for (i = 0; i < g->out[v].len; i++)
+        {
+            a = &g->out[v].a[i];
+            if (g->contracted[a->v])
+                continue;
+            if (n_up == cap_up)
+                ch->up = realloc(ch->up, (cap_up *= 2) * sizeof(Arc));
+            ch->up[n_up++] = *a;
+        }
+        for (i = 0; i < g->in[v].len; i++)
+        {
+            a = &g->in[v].a[i];
+            if (g->contracted[a->v])
+                continue;
+            if (n_down == cap_down)
+                ch->down = realloc(ch->down, (cap_down *= 2) * sizeof(Arc));
+            ch->down[n_down++] = *a;
+        }
+
+        Contract_node(g, v, 0);
+        g->contracted[v] = 1;
+        for (i = 0; i < g->out[v].len; i++)
+            g->deleted[g->out[v].a[i].v]++;
+        for (i = 0; i < g->in[v].len; i++)
+            g->deleted[g->in[v].a[i].v]++;
+    }
+    ch->up_off[n] = n_up;
+    ch->down_off[n] = n_down;
+
+    /* from rank order to vertex order */
+    {
+        long long *up_off = malloc((n + 1) * sizeof(long long));
+        long long *down_off = malloc((n + 1) * sizeof(long long));
+        Arc *up = malloc((n_up + 1) * sizeof(Arc));
+        Arc *down = malloc((n_down + 1) * sizeof(Arc));
+        long long k, len;
+        int r;
+
+        up_off[0] = down_off[0] = 0;
+        for (v = 0; v < n; v++)
+        {
+            r = ch->rank[v];
+            len = ch->up_off[r + 1] - ch->up_off[r];
+            for (k = 0; k < len; k++)
+                up[up_off[v] + k] = ch->up[ch->up_off[r] + k];
+            up_off[v + 1] = up_off[v] + len;
+            len = ch->down_off[r + 1] - ch->down_off[r];
+            for (k = 0; k < len; k++)
+                down[down_off[v] + k] = ch->down[ch->down_off[r] + k];
+            down_off[v + 1] = down_off[v] + len;
+        }
+        free(ch->up_off);
+        free(ch->down_off);
+        free(ch->up);
+        free(ch->down);
+        ch->up_off = up_off;
+        ch->down_off = down_off;
+        ch->up = up;
+        ch->down = down;
+    }
+    free(order.a);
+}
+
+int Write_index(char *path, Ch_index *ch)
+{
+    FILE *f = fopen(path, "wb");
+    char header[CH_HEADER_SIZE];
+    long long n = ch->n;
+    int elem_size = sizeof(long long), ok;
+
+    if (f == NULL)
+        return 1;
+    memcpy(header, CH_MAGIC, 4);
+    memcpy(header + 4, &elem_size, sizeof(int));
+    memcpy(header + 8, &n, sizeof(long long));
+    memcpy(header + 16, &ch->up_off[n], sizeof(long long));
+    memcpy(header + 24, &ch->down_off[n], sizeof(long long));
+    ok = fwrite(header, 1, CH_HEADER_SIZE, f) == CH_HEADER_SIZE &&
+         fwrite(ch->rank, sizeof(int), n, f) == (size_t)n &&
+         fwrite(ch->up_off, sizeof(long long), n + 1, f) == (size_t)n + 1 &&
+         fwrite(ch->down_off, sizeof(long long), n + 1, f) == (size_t)n + 1 &&
+         fwrite(ch->up, sizeof(Arc), ch->up_off[n], f) == (size_t)ch->up_off[n] &&
+         fwrite(ch->down, sizeof(Arc), ch->down_off[n], f) == (size_t)ch->down_off[n];
+    return (fclose(f) != 0 || !ok);
+}
+
+int Read_index(char *path, Ch_index *ch)
+{
+    FILE *f = fopen(path, "rb");
+    char header[CH_HEADER_SIZE];
+    long long n, n_up, n_down;
+    int elem_size, ok;
+
+    if (f == NULL)
+        return 1;
+    if (fread(header, 1, CH_HEADER_SIZE, f) != CH_HEADER_SIZE)
+    {
+        fclose(f);
+        return 1;
+    }
+    memcpy(&elem_size, header + 4, sizeof(int));
+    memcpy(&n, header + 8, sizeof(long long));
+    memcpy(&n_up, header + 16, sizeof(long long));
+    memcpy(&n_down, header + 24, sizeof(long long));
+    if (memcmp(header, CH_MAGIC, 4) != 0 || elem_size != sizeof(long long) || n <= 0 ||
+        n > INT_MAX)
+    {
+        fclose(f);
+        return 1;
+    }
+    ch->n = n;
+    ch->rank = malloc(n * sizeof(int));
+    ch->up_off = malloc((n + 1) * sizeof(long long));
+    ch->down_off = malloc((n + 1) * sizeof(long long));
+    ch->up = malloc((n_up + 1) * sizeof(Arc));
+    ch->down = malloc((n_down + 1) * sizeof(Arc));
+    ok = fread(ch->rank, sizeof(int), n, f) == (size_t)n &&
+         fread(ch->up_off, sizeof(long long), n + 1, f) == (size_t)n + 1 &&
+         fread(ch->down_off, sizeof(long long), n + 1, f) == (size_t)n + 1 &&
+         fread(ch->up, sizeof(Arc), n_up, f) == (size_t)n_up &&
+         fread(ch->down, sizeof(Arc), n_down, f) == (size_t)n_down;
+    fclose(f);
+    return !ok;
+}
+
+/* the weight and skipped vertex of arc u->w, stored at the lower ranked
+ * end */
+static Arc *Find_arc(Ch_index *ch, int u, int w)
+{
+    long long k;
+
+    if (ch->rank[u] < ch->rank[w])
+    {
+        for (k = ch->up_off[u]; k < ch->up_off[u + 1]; k++)
+            if (ch->up[k].v == w)
+                return &ch->up[k];
+    }
+    else
+        for (k = ch->down_off[w]; k < ch->down_off[w + 1]; k++)
+            if (ch->down[k].v == u)
+                return &ch->down[k];
+    return NULL;
+}
+
+/* Appends the vertices after u on arc u->w to path */
+static void Unpack_arc(Ch_index *ch, int u, int w, int mid, int path[], int *len_p)
+{
+    if (mid < 0)
+    {
+        path[(*len_p)++] = w;
+        return;
+    }
+    Unpack_arc(ch, u, mid, Find_arc(ch, u, mid)->mid, path, len_p);
+    Unpack_arc(ch, mid, w, Find_arc(ch, mid, w)->mid, path, len_p);
+}
+
+/* The s-t distance, CH_INF if t can't be reached, and its path in
+ * path[0 .. *len_p - 1] */
+long long Ch_query(Ch_index *ch, int s, int t, int path[], int *len_p, long long *settled_p)
+{
+    /* work arrays, kept from one query to the next */
+    static long long *dist[2] = {NULL, NULL};
+    static int *parent[2], *mid[2], *touched[2], n_touched[2];
+    static Heap heap[2];
+    long long best = CH_INF, k, end;
+    int side, u, x, meet = -1, i, count;
+    Heap_item top;
+    Arc *arcs;
+
+    if (dist[0] == NULL)
+        for (side = 0; side < 2; side++)
+        {
+            dist[side] = malloc(ch->n * sizeof(long long));
+            parent[side] = malloc(ch->n * sizeof(int));
+            mid[side] = malloc(ch->n * sizeof(int));
+            touched[side] = malloc(ch->n * sizeof(int));
+            for (u = 0; u < ch->n; u++)
+                dist[side][u] = CH_INF;
+        }
+    for (side = 0; side < 2; side++)
+    {
+        while (n_touched[side] > 0)
+            dist[side][touched[side][--n_touched[side]]] = CH_INF;
+        heap[side].size = 0;
+        u = side ? t : s;
+        dist[side][u] = 0;
+        parent[side][u] = -1;
+        touched[side][n_touched[side]++] = u;
+        Heap_push(&heap[side], 0, u);
+    }
+    *settled_p = 0;
+
+    while (1)
+    {
+        /* the side with the smaller key, while it can still improve best */
+        for (side = 0; side < 2; side++)
+            if (heap[side].size > 0 && heap[side].a[0].key >= best)
+                heap[side].size = 0;
+        if (heap[0].size == 0 && heap[1].size == 0)
+            break;
+        side = (heap[0].size == 0 ||
+                (heap[1].size > 0 && heap[1].a[0].key < heap[0].a[0].key));
+        top = Heap_pop(&heap[side]);
+        u = top.v;
+        if (top.key > dist[side][u])
+            continue;
+        (*settled_p)++;
+        if (dist[1 - side][u] != CH_INF && top.key + dist[1 - side][u] < best)
+        {
+            best = top.key + dist[1 - side][u];
+            meet = u;
+        }
+        arcs = side ? ch->down : ch->up;
+        k = side ? ch->down_off[u] : ch->up_off[u];
+        end = side ? ch->down_off[u + 1] : ch->up_off[u + 1];
+        for (; k < end; k++)
+        {
+            x = arcs[k].v;
+            if (top.key + arcs[k].w >= dist[side][x])
+                continue;
+            if (dist[side][x] == CH_INF)
+                touched[side][n_touched[side]++] = x;
+            dist[side][x] = top.key + arcs[k].w;
+            parent[side][x] = u;
+            mid[side][x] = arcs[k].mid;
+            Heap_push(&heap[side], dist[side][x], x);
+        }
+    }
+
+    *len_p = 0;
+    if (meet < 0)
+        return CH_INF;
+    /* s .. meet backwards from meet, then meet .. t */
+    count = 0;
+    for (u = meet; u != s; u = parent[0][u])
+        count++;
+    {
+        int *up_path = malloc((count + 1) * sizeof(int));
+
+        for (u = meet, i = count; u != s; u = parent[0][u])
+            up_path[--i] = u;
+        path[(*len_p)++] = s;
+        for (u = s, i = 0; i < count; u = up_path[i++])
+            Unpack_arc(ch, u, up_path[i], mid[0][up_path[i]], path, len_p);
+        free(up_path);
+    }
+    for (u = meet; u != t; u = parent[1][u])
+        Unpack_arc(ch, u, parent[1][u], mid[1][u], path, len_p);
+    return best;
+}
+
+/* s t pairs from argv[first ..] or else from stdin */
+void Query_index(Ch_index *ch, int argc, char *argv[], int first)
+{
+    int *path = malloc(ch->n * sizeof(int)), len, s, t, i, from_args = (first < argc);
+    long long d, settled, sum_settled = 0, queries = 0;
+    double start, total = 0;
+
+    printf("index: %d vertices, %lld up and %lld down arcs\n", ch->n, ch->up_off[ch->n],
+           ch->down_off[ch->n]);
+    while (1)
+    {
+        if (from_args)
+        {
+            if (first + 1 >= argc)
+                break;
+            s = atoi(argv[first]);
+            t = atoi(argv[first + 1]);
+            first += 2;
+        }
+        else if (scanf("%d %d", &s, &t) != 2)
+            break;
+        if (s < 0 || s >= ch->n || t < 0 || t >= ch->n)
+        {
+            fprintf(stderr, "Query %d %d is not in 0..%d\n", s, t, ch->n - 1);
+            continue;
+        }
+
+        start = Now();
+        d = Ch_query(ch, s, t, path, &len, &settled);
+        total += Now() - start;
+        queries++;
+        sum_settled += settled;
+
+        if (d == CH_INF)
+        {
+            printf("dist %d->%d: inf\n", s, t);
+            continue;
+        }
+        printf("dist %d->%d: %lld\nPath %d->%d:", s, t, d, s, t);
+        for (i = 0; i < len; i++)
+            printf(" %d", path[i]);
+        printf("\n");
+    }
+    if (queries > 0)
+        printf("queries: %lld, mean %.3f us, settled per query: %.1f of %d\n", queries,
+               total / queries * 1e6, (double)sum_settled / queries, ch->n);
+    free(path);
+}
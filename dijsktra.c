@@ -11,16 +11,263 @@
  *          mat: the matrix where mat[i][j] is the length
  *               from vertex i to j
  *
- * Output:  length of the shortest path from vertex 0 to vertex v
- *          Shortest path to each vertex v from vertex 0
+ * Output:  length of the shortest path from the source vertex s to vertex v
+ *          Shortest path to each vertex v from s
  *
  * Algorithm: the matrix mat is partioned by columns so that each
  *            process gets n / p columns. In each iteration each
  *            process finds its local vertex with the shortest distance
- *            from the source vertex 0. A global minimum vertex u of the found
+ *            from the source s. A global minimum vertex u of the found
  *            shortest distances is computed and then each process updates
  *            its local distance array if there's a shorter path that goes through u
  *
+ *            Relaxing u and finding the next local minimum is one
+ *            branchless pass over the local block: loc_dist =
+ *            min(loc_dist, dist_u + row u) with the predecessor blended in,
+ *            and the argmin of the new distances of the unknown vertices
+ *            is taken on the way.  Built with -mavx2 or -mavx512f (or -march=native)
+ *            for int distances these are AVX2 / AVX-512 kernels that handle
+ *            8 / 16 vertices per instruction.
+ *
+ *          With -batch the dense matrix is searched from BATCH sources
+ *          (16 with AVX-512, 8 otherwise) at once.  The distances are
+ *          stored source-interleaved, loc_dist[v * BATCH + s], so one
+ *          vector holds vertex v for all sources: relaxing gathers
+ *          element v of the BATCH rows settled in this iteration and
+ *          updates and takes the argmin for every source with the same
+ *          instructions, and one MPI_Allreduce of BATCH MINLOC pairs
+ *          replaces BATCH of them.
+ *
+ *          With -multi a round settles every vertex that is already
+ *          provably final instead of only the global minimum (Crauser
+ *          et al.).  With L the smallest tentative distance, an unknown v
+ *          is final if dist v <= L + min incoming weight of v (IN), or if
+ *          dist v <= min over unknown u of dist u + min outgoing weight
+ *          of u (OUT).  Both bounds come from one MPI_Allreduce, the
+ *          settled vertices of all processes are collected with
+ *          MPI_Allgatherv and every process relaxes its columns from all
+ *          of them.  The minimum weights are computed at load time, the
+ *          outgoing ones with MPI_Reduce_scatter_block over the rows.
+ *
+ *          With -csr the column block of each process is compressed
+ *          into a CSR structure indexed by the global source vertex,
+ *          so relaxing the edges of u only visits the edges u->v
+ *          that actually exist (weight < INFINITY) instead of all n / p
+ *          entries of the row.  The local vertices that have been reached
+ *          but are not yet known are kept in a 4-ary heap with
+ *          decrease-key, so the local minimum is read off the top instead
+ *          of scanning all n / p distances every iteration.
+ *
+ *          With -edges <file> the graph is read from an edge list
+ *          instead of the matrix on stdin.  Each process reads its own
+ *          byte range of the file, the edges are sent to the process
+ *          owning their destination vertex with MPI_Alltoallv and
+ *          every process builds its CSR block from what it received.
+ *          The file has one "src dst weight" edge per line; a line with
+ *          a single number gives n, lines starting with '#' or '%' are
+ *          skipped, otherwise n is the largest vertex + 1.  If n is not
+ *          divisible by p the last block is padded with isolated
+ *          vertices that are not printed.
+ *
+ *          With -bin <file> the dense matrix is read from a binary
+ *          file: the 4 bytes "DJKM", the element size (4), n as int64
+ *          and then the n * n int32 weights row by row.  The column block type is used as the file view so
+ *          every process reads its own columns with one collective
+ *          MPI_File_read_at_all and nothing is staged on process 0.
+ *          matrix_gen.py writes matrix.bin next to matrix.txt.
+ *
+ *          With -delta <D> the distances are computed by delta-stepping
+ *          instead: vertices are kept in buckets of width D and a whole
+ *          bucket is settled per phase.  Each light round (edges of
+ *          weight <= D out of the current bucket) and the heavy round
+ *          at the end of the phase send their relaxation requests to
+ *          the owners of the targets in one MPI_Alltoallv, so the number
+ *          of rounds follows max distance / D instead of n.  The edges
+ *          are regrouped by source vertex for this (one more
+ *          Alltoallv at load time).  D <= 0 picks D = max weight /
+ *          average degree.
+ *
+ * APSP:    with -apsp all pairs distances are computed instead, by a
+ *          blocked Floyd-Warshall on a pr x pc process grid.  The dense
+ *          matrix is redistributed 2D block-cyclic in nb x nb blocks
+ *          (block (I, J) on process (I mod pr, J mod pc)) with one
+ *          MPI_Alltoallv.  In phase K the owner closes the diagonal
+ *          block, it is broadcast along its process row and column to
+ *          update the row and column panels K, the column panel is
+ *          broadcast along every process row and the row panel along
+ *          every process column, and every process does one min-plus
+ *          update of its whole local array with them.  The min-plus
+ *          products are the register-tiled kernels of minplus.h (AVX2 /
+ *          AVX-512 when built for them, OpenMP threads with -fopenmp).
+ *          The result is written to apsp_output.bin in the -bin format
+ *          (element size sizeof(dist_t), DIST_INF where there is no
+ *          path) with one collective write through a darray file view.
+ *
+ * Threads: compiled with -fopenmp every process splits its relaxation and
+ *          argmin into OMP_CHUNK vertex chunks shared by its threads, and
+ *          the per thread argmins are merged before the MINLOC, so one
+ *          process per node or socket with OMP_NUM_THREADS cores takes
+ *          part in the collectives instead of one per core.  Only the
+ *          master thread calls MPI (MPI_THREAD_FUNNELED).  The dense,
+ *          -multi and -2d searches are threaded.
+ *
+ * MINLOC:  with -hier every MINLOC over all processes (or over the group
+ *          with -groups) is done in two levels, so the -server, -t,
+ *          -radius / -knn and -updates searches get it too.  The
+ *          processes of a node (MPI_Comm_split_type SHARED) write their
+ *          candidate as one 64-bit key, distance bits above vertex + 1,
+ *          to their own cache line of an MPI_Win_allocate_shared window,
+ *          the node leader spins on the sequence numbers next to them,
+ *          takes the smallest key and reduces it with MPI_MIN over the
+ *          leaders only, and the node waits for the result line.  For
+ *          nonnegative distances the key order is the MINLOC order.  It
+ *          needs 32-bit distances and vertex numbers.  -minloc-bench
+ *          <iters> only times this against the flat MPI_Allreduce and
+ *          exits.
+ *
+ * P2P:     with -t <v> only the path from each source to v is wanted and
+ *          the dense search stops once v is settled.  -potential <file>
+ *          (n numbers h(v), consistent: h(u) <= w(u, v) + h(v)) makes it
+ *          A*, the MINLOC then picks the smallest dist + h.  -bidir runs
+ *          the search from the source on half of the processes and the
+ *          search from v over the reversed edges (the blocks transposed
+ *          with one MPI_Alltoall) on the other half, in lock step.  After
+ *          every step the processes that hold the same vertices swap
+ *          the vertex they settled, the side that did not settle it adds
+ *          its own tentative distance of it, and a MINLOC over both halves
+ *          keeps the shortest such s - v - t path mu.  The search stops
+ *          when the two last settled distances add up to mu or more.
+ *          The output gets the distance, the path, the settled vertices
+ *          and the time of each query.
+ *
+ * Bounded: -radius <R> only wants the vertices within distance R of each
+ *          source and -knn <k> only the k nearest ones (both can be
+ *          given).  The dense search stops when the MINLOC winner is
+ *          farther than R or k vertices besides the source are settled,
+ *          so it takes as many steps as there are answers instead of
+ *          n - 1.  Each process then sends only its settled vertices
+ *          (distance, vertex, predecessor) with one MPI_Gatherv, and the
+ *          output lists them nearest first with their paths, which stay
+ *          inside the settled set.  -server knn queries on the dense
+ *          matrix use the same search.
+ *
+ * ALT:     -landmarks <k> picks k landmarks L by farthest point selection
+ *          (the first is the vertex farthest from vertex 0, each next
+ *          one the reachable vertex farthest from the landmarks so far)
+ *          and keeps d(L, v) and d(v, L) for the local vertices v, the
+ *          second from the same dense search on the transposed blocks.
+ *          The index is written to -alt <file> (default ALT_FILE) with
+ *          MPI-IO: "DJAL", the distance size, n and k as int64, the k
+ *          landmarks as int64 and then 2k rows of n distances; -alt
+ *          alone reads it back.  With -t the triangle inequality bounds
+ *          h(v) = max over L of d(L, t) - d(L, v) and d(v, L) - d(t, L)
+ *          are the A* potential, so far fewer vertices get settled.
+ *
+ * Updates: -updates <file> changes edge weights after the first search
+ *          and repairs the trees instead of searching again.  The file
+ *          has "u v w" lines (w = INFINITY deletes the edge, a weight
+ *          for a missing edge inserts it) in batches separated by blank
+ *          lines.  For each batch the owners of the columns apply the
+ *          new weights and flag the tree edges pred[v] = u that got
+ *          heavier; after one MPI_Allgather of the distances and
+ *          predecessors every process finds the subtrees below them.
+ *          Those vertices are reset to the best distance over their
+ *          unaffected in-neighbours, the heads of the edges that got
+ *          lighter get the new candidate, and a Dijkstra over only these
+ *          queued vertices (queued again when relaxed) settles
+ *          everything that changed, as in Ramalingam and Reps.  Dense
+ *          matrix only; the output has the final trees and the vertices
+ *          and time of each repair.
+ *
+ * Server:  -server keeps the distributed graph and answers queries until
+ *          quit, one per line on stdin (after the matrix when that is read
+ *          from stdin too) or, with -socket <path>, from clients of a
+ *          Unix domain socket, one at a time:
+ *              sssp <s>       distances from s to every vertex
+ *              path <s> <t>   distance and path from s to t
+ *              knn <s> <k>    the k vertices nearest to s
+ *              quit
+ *          Process 0 parses the line and broadcasts it, the search runs
+ *          on all processes (dense or -csr; path stops at t) and the
+ *          answer, with its latency, goes back to where the query came
+ *          from.  The output file gets the load time and the latencies.
+ *
+ * 2D:      -2d runs the plain dense search on the same pr x pc grid
+ *          (MPI_Cart_create, row and column communicators from
+ *          MPI_Cart_sub) instead of over n x n / p column blocks.  The
+ *          distances of the vertices of a grid column are kept by every
+ *          process in that column.  Each step is one MINLOC over the pc
+ *          processes of a grid row, after which the process holding row u
+ *          in its grid column broadcasts its loc_cols weights of it to the
+ *          pr processes of the column.  A process stores n^2 / p weights
+ *          and every collective has about sqrt(p) processes in it.
+ *
+ * Queries: the source is vertex 0 unless given with -s <v> (repeatable)
+ *          or -queries <file> (vertex numbers separated by white space).
+ *          The graph is read and distributed once and every source is
+ *          then solved in turn with the same engine; the output file
+ *          gets one distance and path table per source and the times
+ *          are summed over all of them.
+ *
+ *          With several sources the processes can also be split into
+ *          groups that each solve a share of the sources (source j in
+ *          group j mod g).  The graph is still read over all p processes;
+ *          the g processes holding consecutive blocks then merge them
+ *          with one MPI_Allgather so every group of p / g processes has
+ *          the whole graph.  -groups <g> sets g, by default it is chosen
+ *          from a cost model: a query on q processes takes about
+ *          n * alpha * log2 q for the MINLOC reductions plus
+ *          work / q * beta for the relaxations, alpha and beta are
+ *          measured at startup, and g must divide p and keep the merged
+ *          block under GROUP_MEM_LIMIT bytes.
+ *
+ * Paths:   by default process 0 writes the paths into the output file
+ *          after gathering the predecessors.  With -paths <file> (text,
+ *          the same lines) or -paths-bin <file> every process writes the
+ *          paths of its own n / p block of vertices: process 0 broadcasts
+ *          the predecessors of a source, each process works out the
+ *          length of its lines from the lengths of their predecessors
+ *          (each vertex once), one MPI_Allgather of the block lengths
+ *          gives every process its file offset, and the lines are
+ *          written with MPI-IO through a PATH_BUF byte buffer.  The
+ *          binary file is "DJPT", the size of a vertex number and n as
+ *          int64, then per source: src as int64, n + 1 int64 offsets
+ *          into the vertex numbers that follow, and the path src .. v of
+ *          every vertex v between offsets v and v + 1.
+ *
+ * Cache:   with -cache <MB> every process keeps the local distance and
+ *          predecessor tables of the last sources it solved, at most MB
+ *          megabytes of them, and a source met again (in -s / -queries
+ *          or in a -server query) is copied from there instead of being
+ *          searched.  All processes of a search hold the same sources,
+ *          so they agree on hits without any messages; the least recently
+ *          used tree makes room for a new one.  Not used with -batch.
+ *
+ * Types:   vertex numbers and distances are int by default.  Compile
+ *          with -DIDX_INT64 for 64-bit vertex numbers, predecessors and
+ *          edge offsets, and with -DDIST_INT64 or -DDIST_FLOAT for 64-bit
+ *          or float weights and distances.  Relaxation saturates at
+ *          DIST_INF, the distance of an unreachable vertex, so INFINITY
+ *          only marks a missing edge in the input matrix.
+ *
+ * Usage:   mpiexec -n <p> mpi_Dijkstra [-csr | -multi] < matrix.txt
+ *          mpiexec -n <p> mpi_Dijkstra -s 5 -s 17 -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -queries sources.txt -groups 4 -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -queries sources.txt -batch -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -apsp -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -2d -queries sources.txt -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -s 5 -t 17 [-bidir | -potential h.txt] -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -landmarks 16 [-alt alt.bin] -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -alt alt.bin -s 5 -t 17 -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -updates changes.txt -s 5 -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra [-radius 50] [-knn 10] -s 5 -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -server [-socket /tmp/dijkstra.sock] -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -cache 256 -queries sources.txt -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -queries sources.txt -paths paths.txt -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra [-csr] -bin matrix.bin
+ *          mpiexec -n <p> mpi_Dijkstra -edges graph.txt
+ *          mpiexec -n <p> mpi_Dijkstra -edges graph.txt -delta 0
+ *
  * Note:    1. This program assumes n is evenly divisible by
  *             p (number of processes)
  *          2. Edge weights should be nonnegative
@@ -35,71 +282,744 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <mpi.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+#include <float.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "minplus.h"
 #define INFINITY 1000000
+#define BIN_MAGIC "DJKM"
+#define BIN_HEADER_SIZE 16
+#define GROUP_MEM_LIMIT (1LL << 30)
+#define APSP_BLOCK 64
+#define OMP_CHUNK 4096
+#define HIER_LINE 64
+#define HIER_SPINS 1000
+#define QUERY_QUIT 0
+#define QUERY_SSSP 1
+#define QUERY_PATH 2
+#define QUERY_KNN 3
+#define QUERY_LINE 256
+#define APSP_FILE "apsp_output.bin"
+#define ALT_MAGIC "DJAL"
+#define ALT_HEADER_SIZE 24
+#define ALT_FILE "alt_index.bin"
+#define PATH_MAGIC "DJPT"
+#define PATH_HEADER_SIZE 16
+#define PATH_BUF (1 << 22)
+#define READ_CHUNK (1 << 30)
+
+#ifdef IDX_INT64
+typedef long long idx_t;
+#define MPI_IDX_T MPI_LONG_LONG
+#define IDX_FMT "%lld"
+#else
+typedef int idx_t;
+#define MPI_IDX_T MPI_INT
+#define IDX_FMT "%d"
+#endif
+
+#if defined(DIST_FLOAT)
+typedef float dist_t;
+#define MPI_DIST_T MPI_FLOAT
+#define DIST_FMT "%g"
+#define DIST_SCAN_FMT "%f"
+#define DIST_INF FLT_MAX
+#elif defined(DIST_INT64)
+typedef long long dist_t;
+#define MPI_DIST_T MPI_LONG_LONG
+#define DIST_FMT "%lld"
+#define DIST_SCAN_FMT "%lld"
+#define DIST_INF LLONG_MAX
+#else
+typedef int dist_t;
+#define MPI_DIST_T MPI_INT
+#define DIST_FMT "%d"
+#define DIST_SCAN_FMT "%d"
+#define DIST_INF INT_MAX
+#endif
+
+/* the vector kernels are written for 32-bit distances and vertices */
+#if !defined(IDX_INT64) && !defined(DIST_INT64) && !defined(DIST_FLOAT)
+#if defined(__AVX512F__)
+#define SIMD_AVX512
+#elif defined(__AVX2__)
+#define SIMD_AVX2
+#endif
+#endif
+
+/* sources per -batch search, one vector of 32-bit distances */
+#if defined(SIMD_AVX512)
+#define BATCH 16
+#else
+#define BATCH 8
+#endif
+
+/* the MINLOC pair fits a 64-bit key */
+#if !defined(IDX_INT64) && !defined(DIST_INT64)
+#define HIER_MINLOC
+#endif
+
+/* d + w, or DIST_INF if that would reach or pass DIST_INF */
+static inline dist_t Sat_add(dist_t d, dist_t w)
+{
+    return (w >= DIST_INF - d) ? DIST_INF : d + w;
+}
+
+/* (distance, vertex) pair for the MINLOC reductions.  For int/int and
+ * float/int this is the layout of MPI_2INT and MPI_FLOAT_INT, the other
+ * combinations use a struct type and a user defined op */
+typedef struct
+{
+    dist_t dist;
+    idx_t v;
+} Dist_loc;
 
-int Read_n(int my_rank, MPI_Comm comm);
-MPI_Datatype Build_blk_col_type(int n, int loc_n);
-void Read_matrix(int loc_mat[], int n, int loc_n, MPI_Datatype blk_col_mpi_t,
+MPI_Datatype dist_loc_mpi_t;
+MPI_Op min_loc_op;
+
+/* Two level MINLOC over comm, see MINLOC in the header.  Line i of the
+ * shared window belongs to node rank i, line node_size to the result;
+ * a line is the key followed by the sequence number of its call */
+typedef struct
+{
+    MPI_Comm comm;
+    MPI_Comm node_comm;   /* processes of comm on my node */
+    MPI_Comm leader_comm; /* node rank 0 of every node, else MPI_COMM_NULL */
+    MPI_Win win;
+    char *base;
+    int node_rank, node_size;
+    uint64_t seq;
+} Hier_min;
+
+/* set by -hier for the search communicator */
+Hier_min *hier_min = NULL;
+
+/* an edge on its way to the process that owns it, also used for the
+ * relaxation requests of delta-stepping (u = pred, w = new distance) */
+typedef struct
+{
+    idx_t u, v;
+    dist_t w;
+} Edge;
+
+/* Local part of the graph in compressed sparse row form.  Row u holds
+ * the edges u->v for the local vertices v of this process, so the
+ * partition is the same as the dense column block: n + 1 row offsets
+ * and one entry per existing edge */
+typedef struct
+{
+    idx_t *row_ptr; /* n + 1 offsets into col_idx and weight */
+    idx_t *col_idx; /* local index of the destination vertex  */
+    dist_t *weight; /* weight of the edge                     */
+    idx_t nnz;      /* number of local edges                  */
+} Loc_csr;
+
+/* Addressable 4-ary min-heap of local vertices ordered by loc_dist, ties
+ * by vertex.  pos[v] is the index of v in heap, or -1 if v is not in it */
+typedef struct
+{
+    idx_t *heap;
+    idx_t *pos;
+    dist_t *key; /* loc_dist */
+    idx_t size;
+} Loc_heap;
+
+/* Cyclic array of buckets of local vertices for delta-stepping.  A
+ * vertex is appended to bucket floor(dist / delta) whenever its distance
+ * drops, stale entries are skipped when the bucket is scanned.  With
+ * max weight W only W / delta + 2 buckets can be in use at a time */
+typedef struct
+{
+    idx_t **v;     /* vertices of each slot      */
+    idx_t *len;    /* entries in each slot       */
+    idx_t *cap;    /* allocated size of each slot */
+    long long n_slots;
+} Buckets;
+
+/* pr x pc process grid of the -apsp mode.  Process rank is at (rank / pc,
+ * rank % pc) and keeps its blocks of the 2D block-cyclic distribution as
+ * a loc_rows x loc_cols row-major array in global order */
+typedef struct
+{
+    idx_t n, nb, n_blk;
+    int pr, pc, my_r, my_c;
+    idx_t loc_rows, loc_cols;
+    MPI_Comm cart_comm;
+    MPI_Comm row_comm; /* processes of my grid row, ranked by column */
+    MPI_Comm col_comm; /* processes of my grid column, ranked by row */
+} Grid_2d;
+
+/* Landmark index of -landmarks / -alt: row i of loc_dist has d(L_i, v)
+ * and row k + i has d(v, L_i) for the loc_n local vertices v */
+typedef struct
+{
+    int k;
+    idx_t *landmarks;
+    dist_t *loc_dist;
+} Alt_index;
+
+/* LRU cache of local shortest path trees, see Cache in the header.
+ * Slot i holds the loc_len distances and predecessors of source src[i],
+ * allocated when first used; stamp[i] is the time of its last use */
+typedef struct
+{
+    idx_t loc_len;
+    int cap, used;
+    idx_t *src;
+    long long *stamp;
+    dist_t **dist;
+    idx_t **pred;
+    long long clock, hits, misses;
+} Sp_cache;
+
+/* -paths / -paths-bin file shared by all processes.  off is where the
+ * paths of the next source start; buf collects len bytes that go to
+ * buf_off */
+typedef struct
+{
+    MPI_File fh;
+    int binary;
+    MPI_Offset off, buf_off;
+    char *buf;
+    size_t len;
+} Path_file;
+
+typedef struct
+{
+    int use_csr;     /* -csr: relax over a sparse local graph    */
+    char *edge_file; /* -edges <file>: parallel edge list input */
+    char *bin_file;  /* -bin <file>: binary dense matrix input   */
+    int use_delta;   /* -delta <D>: delta-stepping with width D */
+    double delta;
+    int use_multi;   /* -multi: settle all safe vertices per round */
+    idx_t *sources;  /* -s <v>: source vertices, default vertex 0 */
+    idx_t n_sources;
+    char *query_file; /* -queries <file>: more source vertices */
+    int groups;       /* -groups <g>: solve sources in g groups, 0 = auto */
+    int use_batch;    /* -batch: BATCH dense sources per search */
+    int use_apsp;     /* -apsp: all pairs by blocked Floyd-Warshall */
+    int use_2d;       /* -2d: dense search on a 2D process grid    */
+    int use_hier;     /* -hier: shared memory + leaders MINLOC    */
+    int bench_iters;  /* -minloc-bench: time MINLOC and exit       */
+    idx_t target;     /* -t <v>: only the paths to v, -1 = all     */
+    int use_bidir;    /* -bidir: search from both ends on 2 halves */
+    char *potential_file; /* -potential <file>: A* heuristic     */
+    int use_server;    /* -server: answer queries until quit      */
+    char *socket_path; /* -socket <path>: queries from a socket   */
+    double cache_mb;   /* -cache <MB>: keep solved trees, 0 = off */
+    int n_landmarks;   /* -landmarks <k>: build an ALT index      */
+    char *alt_file;    /* -alt <file>: where the ALT index is     */
+    char *update_file; /* -updates <file>: weight change batches  */
+    double radius;     /* -radius <R>: vertices within R, -1 = all */
+    idx_t knn;         /* -knn <k>: the k nearest vertices, 0 = all */
+    char *path_file;   /* -paths / -paths-bin <file>: parallel paths */
+    int path_binary;
+} Options;
+
+void Parse_args(int argc, char **argv, Options *opts);
+void Read_sources(char *path, Options *opts, int my_rank, MPI_Comm comm);
+int Choose_groups(idx_t n, double work, double loc_bytes, idx_t n_sources, int p,
+                  MPI_Comm comm);
+MPI_Datatype Build_strided_blk_type(idx_t rows, idx_t loc_n, idx_t stride,
+                                   MPI_Datatype elem_mpi_t);
+void Merge_blk_cols(dist_t **loc_mat_p, idx_t n, idx_t loc_n, MPI_Comm cross_comm);
+void Merge_loc_csr(Loc_csr *csr, idx_t n, idx_t loc_n, MPI_Comm cross_comm);
+void Build_min_loc_type(void);
+void Free_min_loc_type(void);
+void Build_hier_min(MPI_Comm comm, Hier_min *h);
+void Init_sp_cache(Sp_cache *c, double mb, idx_t loc_len, MPI_Comm comm);
+int Sp_cache_get(Sp_cache *c, idx_t src, dist_t loc_dist[], idx_t loc_pred[]);
+void Sp_cache_put(Sp_cache *c, idx_t src, dist_t loc_dist[], idx_t loc_pred[]);
+void Free_sp_cache(Sp_cache *c);
+void Free_hier_min(Hier_min *h);
+void Min_loc_allreduce(Dist_loc *my_min, Dist_loc *glbl_min, MPI_Comm comm);
+void Bench_min_loc(int iters, int my_rank, MPI_Comm comm);
+void Min_loc(void *in, void *inout, int *len, MPI_Datatype *type);
+idx_t Read_n(int my_rank, MPI_Comm comm);
+MPI_Datatype Build_blk_col_type(idx_t n, idx_t loc_n, MPI_Datatype elem_mpi_t);
+void Read_matrix(dist_t loc_mat[], idx_t n, idx_t loc_n, MPI_Datatype blk_col_mpi_t,
                  int my_rank, MPI_Comm comm);
-void Dijkstra_Init(int loc_mat[], int loc_pred[], int loc_dist[], int loc_known[],
-                   int my_rank, int loc_n);
-void Dijkstra(int loc_mat[], int loc_dist[], int loc_pred[], int loc_n, int n,
-              MPI_Comm comm);
-int Find_min_dist(int loc_dist[], int loc_known[], int loc_n);
-void Print_matrix(int global_mat[], int rows, int cols);
-void Print_dists(int global_dist[], int n, FILE *output_file);
-void Print_paths(int global_pred[], int n, FILE *output_file);
+MPI_File Open_bin_matrix(char *path, idx_t *n_p, int my_rank, MPI_Comm comm);
+void Read_bin_matrix(MPI_File fh, dist_t loc_mat[], idx_t n, idx_t loc_n,
+                     MPI_Datatype blk_col_mpi_t, int my_rank);
+void Dijkstra_Init(dist_t loc_mat[], idx_t src, idx_t loc_pred[], dist_t loc_dist[],
+                   int loc_known[], int my_rank, idx_t loc_n);
+void Dijkstra(dist_t loc_mat[], idx_t src, dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n,
+              idx_t n, MPI_Comm comm);
+void Dijkstra_batch(dist_t loc_mat[], idx_t srcs[], dist_t loc_dist[], idx_t loc_pred[],
+                    idx_t loc_n, idx_t n, MPI_Comm comm);
+void P2p_queries(dist_t **loc_mat_p, idx_t n, idx_t loc_n, Options *opts, double load_time,
+                 int my_rank, int p);
+void Dijkstra_p2p(dist_t loc_mat[], dist_t h[], idx_t src, idx_t tgt, dist_t loc_dist[],
+                  idx_t loc_pred[], idx_t loc_n, idx_t n, MPI_Comm comm,
+                  long long *settled_p);
+void Dijkstra_bidir(dist_t loc_mat[], idx_t root, dist_t loc_dist[], idx_t loc_pred[],
+                    idx_t loc_n, MPI_Comm comm, MPI_Comm pair_comm, Dist_loc *best_p,
+                    long long *settled_p);
+void Transpose_blk_cols(dist_t loc_mat[], idx_t n, idx_t loc_n, MPI_Comm comm);
+void Serve_queries(dist_t loc_mat[], Loc_csr *csr, idx_t n, idx_t loc_n, Options *opts,
+                   double load_time, int my_rank, int p);
+void Answer_query(idx_t cmd[], dist_t global_dist[], idx_t global_pred[], idx_t n,
+                  double latency, FILE *out);
+dist_t *Read_potential(char *path, idx_t n, int my_rank, MPI_Comm comm);
+void Build_alt(dist_t loc_mat[], idx_t n, idx_t loc_n, int k, Alt_index *alt, MPI_Comm comm);
+void Write_alt(char *path, Alt_index *alt, idx_t n, idx_t loc_n, MPI_Comm comm);
+int Read_alt(char *path, Alt_index *alt, idx_t n, idx_t loc_n, MPI_Comm comm);
+dist_t *Alt_potential(Alt_index *alt, idx_t tgt, idx_t n, idx_t loc_n, MPI_Comm comm);
+void Free_alt(Alt_index *alt);
+void Dijkstra_bounded(dist_t loc_mat[], idx_t src, dist_t radius, idx_t k, dist_t loc_dist[],
+                      idx_t loc_pred[], int loc_known[], idx_t loc_n, idx_t n, MPI_Comm comm,
+                      long long *settled_p);
+Dist_loc *Gather_settled(dist_t loc_dist[], idx_t loc_pred[], int loc_known[], idx_t loc_n,
+                         idx_t global_pred[], idx_t *count_p, int my_rank, MPI_Comm comm);
+void Bounded_queries(dist_t loc_mat[], idx_t n, idx_t loc_n, Options *opts, double load_time,
+                     int my_rank);
+void Solve_sources(dist_t **loc_mat_p, Loc_csr *csr, idx_t n, idx_t loc_n, Options *opts,
+                   double start, int my_rank, int p);
+void Print_bounded(Dist_loc near[], idx_t count, idx_t global_pred[], idx_t src, idx_t n,
+                   FILE *output_file);
+Edge *Read_updates(char *path, idx_t n, idx_t *n_batches_p, idx_t **batch_off_p, int my_rank,
+                   MPI_Comm comm);
+void Dynamic_updates(dist_t loc_mat[], idx_t n, idx_t loc_n, Options *opts, double load_time,
+                     int my_rank);
+long long Repair_sssp(dist_t loc_mat[], Edge upd[], dist_t old_w[], idx_t m, idx_t src,
+                      dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n, idx_t n, MPI_Comm comm);
+void Print_p2p(idx_t fwd_pred[], idx_t rev_pred[], idx_t src, idx_t tgt, Dist_loc *best,
+               long long settled[], double time, idx_t n, FILE *output_file);
+void Relax_batch(dist_t loc_mat[], idx_t u[], dist_t d[], dist_t loc_dist[],
+                 idx_t loc_pred[], int loc_known[], idx_t loc_n, Dist_loc my_min[],
+                 int my_rank);
+void Min_in_out(dist_t loc_mat[], idx_t n, idx_t loc_n, dist_t min_in[],
+                dist_t min_out[], int my_rank, MPI_Comm comm);
+void Build_grid_2d(idx_t n, int p, int my_rank, Grid_2d *grid);
+void Free_grid_2d(Grid_2d *grid);
+void Blk_col_to_2d(dist_t loc_mat[], idx_t loc_n, Grid_2d *grid, dist_t a[],
+                   int my_rank, MPI_Comm comm);
+void Floyd_warshall_2d(dist_t a[], Grid_2d *grid);
+void Dijkstra_2d(dist_t a[], Grid_2d *grid, idx_t src, dist_t loc_dist[], idx_t loc_pred[]);
+void Gather_2d(Grid_2d *grid, dist_t loc_dist[], idx_t loc_pred[], dist_t global_dist[],
+               idx_t global_pred[]);
+void Minplus_block(dist_t c[], idx_t ldc, dist_t a[], idx_t lda, dist_t b[], idx_t ldb,
+                   idx_t m, idx_t n_cols, idx_t k_len);
+void Write_apsp(char *path, dist_t a[], Grid_2d *grid, int my_rank, MPI_Comm comm);
+void Dijkstra_multi(dist_t loc_mat[], dist_t min_in[], dist_t min_out[], idx_t src,
+                    dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n, idx_t n,
+                    MPI_Comm comm, long long *rounds_p);
+void Build_loc_csr(dist_t loc_mat[], idx_t n, idx_t loc_n, Loc_csr *csr);
+void Read_edge_list(char *path, idx_t *n_p, idx_t *loc_n_p, Loc_csr *csr,
+                    int my_rank, int p, MPI_Comm comm);
+char *Read_my_lines(MPI_File fh, int my_rank, int p, MPI_Offset *len_p);
+void Free_loc_csr(Loc_csr *csr);
+Edge *Route_edges(Edge edges[], idx_t n_edges, int by_src, idx_t loc_n,
+                  MPI_Comm comm, idx_t *n_recv_p);
+void Build_csr_from_edges(Edge edges[], idx_t n_edges, idx_t n_rows,
+                          idx_t row_base, idx_t col_base, Loc_csr *csr);
+void Transpose_loc_csr(Loc_csr *in, idx_t n, idx_t loc_n, Loc_csr *out,
+                       int my_rank, MPI_Comm comm);
+void Delta_stepping(Loc_csr *out, double delta, idx_t src, dist_t loc_dist[],
+                    idx_t loc_pred[], idx_t loc_n, MPI_Comm comm, long long *phases_p,
+                    long long *rounds_p);
+void Dijkstra_csr_Init(Loc_csr *csr, idx_t src, idx_t loc_pred[], dist_t loc_dist[],
+                       int loc_known[], int my_rank, idx_t loc_n);
+void Dijkstra_csr(Loc_csr *csr, idx_t src, dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n,
+                  idx_t n, MPI_Comm comm);
+idx_t Find_min_dist(dist_t loc_dist[], int loc_known[], idx_t loc_n);
+idx_t Relax_find_min_par(dist_t row[], dist_t dist_u, idx_t glbl_u, dist_t loc_dist[],
+                         idx_t loc_pred[], int loc_known[], idx_t loc_n);
+idx_t Relax_find_min(dist_t row[], dist_t dist_u, idx_t glbl_u, dist_t loc_dist[],
+                     idx_t loc_pred[], int loc_known[], idx_t loc_n);
+void Heap_init(Loc_heap *h, dist_t loc_dist[], idx_t loc_n);
+void Heap_free(Loc_heap *h);
+void Heap_decrease(Loc_heap *h, idx_t v);
+idx_t Heap_pop(Loc_heap *h);
+void Print_matrix(dist_t global_mat[], idx_t rows, idx_t cols);
+void Print_dists(dist_t global_dist[], idx_t src, idx_t n, FILE *output_file);
+void Print_paths(idx_t global_pred[], idx_t src, idx_t n, FILE *output_file);
+int Open_path_file(Path_file *pf, char *path, int binary, idx_t n, MPI_Comm comm);
+void Write_paths_par(idx_t global_pred[], idx_t src, idx_t n, Path_file *pf, MPI_Comm comm);
+void Close_path_file(Path_file *pf);
 
 int main(int argc, char **argv)
 {
-    int *loc_mat, *loc_dist, *loc_pred, *global_dist = NULL, *global_pred = NULL;
-    int my_rank, p, loc_n, n;
+    dist_t *loc_mat = NULL;
+    idx_t loc_n, n, q;
+    int my_rank, p;
     MPI_Comm comm;
-    MPI_Datatype blk_col_mpi_t;
+    MPI_Datatype blk_col_mpi_t = MPI_DATATYPE_NULL;
+    MPI_File bin_fh;
+    Loc_csr csr;
+    Options opts;
+    Hier_min hier;
+    double start, load_time;
 
-    double start, end, comm_time, total_time;
+#ifdef _OPENMP
+    int provided;
 
-    MPI_Init(NULL, NULL);
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+#else
+    MPI_Init(&argc, &argv);
+#endif
+    Parse_args(argc, argv, &opts);
     comm = MPI_COMM_WORLD;
     MPI_Comm_rank(comm, &my_rank);
     MPI_Comm_size(comm, &p);
-    // so luong mau dau vao
-    n = Read_n(my_rank, comm);
-    loc_n = n / p;
-    loc_mat = malloc(n * loc_n * sizeof(int));
-    loc_dist = malloc(loc_n * sizeof(int));
-    loc_pred = malloc(loc_n * sizeof(int));
-    if (loc_mat == NULL || loc_dist == NULL || loc_pred == NULL)
+    Build_min_loc_type();
+    if (opts.bench_iters > 0)
     {
-        fprintf(stderr, "Memory allocation failed\n");
+        Bench_min_loc(opts.bench_iters, my_rank, comm);
+        Free_min_loc_type();
         MPI_Finalize();
-        exit(-1);
+        return 0;
+    }
+    if (opts.query_file != NULL)
+        Read_sources(opts.query_file, &opts, my_rank, comm);
+    if (opts.n_sources == 0)
+    {
+        opts.sources = malloc(sizeof(idx_t));
+        opts.sources[0] = 0;
+        opts.n_sources = 1;
+    }
+    start = MPI_Wtime();
+    if (opts.edge_file != NULL)
+    {
+        /* n and loc_n come from the file, the graph is only kept as CSR */
+        Read_edge_list(opts.edge_file, &n, &loc_n, &csr, my_rank, p, comm);
+        opts.use_csr = 1;
+    }
+    else
+    {
+        // so luong mau dau vao
+        if (opts.bin_file != NULL)
+            bin_fh = Open_bin_matrix(opts.bin_file, &n, my_rank, comm);
+        else
+            n = Read_n(my_rank, comm);
+        if (n % p != 0)
+        {
+            if (my_rank == 0)
+                fprintf(stderr, "Number of vertices must be evenly divisible by number of processes.\n");
+            MPI_Finalize();
+            exit(-1);
+        }
+        loc_n = n / p;
+        loc_mat = malloc((size_t)n * loc_n * sizeof(dist_t));
+        if (loc_mat == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            MPI_Finalize();
+            exit(-1);
+        }
+
+        if (opts.bin_file != NULL)
+        {
+            /* the file view is in terms of the int32 weights on disk */
+            blk_col_mpi_t = Build_blk_col_type(n, loc_n, MPI_INT);
+            Read_bin_matrix(bin_fh, loc_mat, n, loc_n, blk_col_mpi_t, my_rank);
+            MPI_File_close(&bin_fh);
+        }
+        else
+        {
+            blk_col_mpi_t = Build_blk_col_type(n, loc_n, MPI_DIST_T);
+            Read_matrix(loc_mat, n, loc_n, blk_col_mpi_t, my_rank, comm);
+        }
+        if (opts.use_csr)
+        {
+            /* the dense block is no longer needed once it is compressed */
+            Build_loc_csr(loc_mat, n, loc_n, &csr);
+            free(loc_mat);
+            loc_mat = NULL;
+        }
     }
 
-    blk_col_mpi_t = Build_blk_col_type(n, loc_n);
+    for (q = 0; q < opts.n_sources; q++)
+        if (opts.sources[q] < 0 || opts.sources[q] >= n)
+        {
+            if (my_rank == 0)
+                fprintf(stderr, "Source vertex " IDX_FMT " is not in 0.." IDX_FMT "\n",
+                        opts.sources[q], n - 1);
+            MPI_Finalize();
+            exit(-1);
+        }
 
-    if (my_rank == 0)
+    if (opts.use_apsp && loc_mat == NULL)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-apsp needs the dense matrix, ignoring it\n");
+        opts.use_apsp = 0;
+    }
+    if (opts.target >= 0 && loc_mat == NULL)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-t needs the dense matrix, ignoring it\n");
+        opts.target = -1;
+    }
+    if (opts.n_landmarks > 0 && loc_mat == NULL)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-landmarks needs the dense matrix, ignoring it\n");
+        opts.n_landmarks = 0;
+    }
+    if ((opts.radius >= 0 || opts.knn > 0) && loc_mat == NULL)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-radius and -knn need the dense matrix, ignoring them\n");
+        opts.radius = -1;
+        opts.knn = 0;
+    }
+    if (opts.update_file != NULL && loc_mat == NULL)
     {
-        global_dist = malloc(n * sizeof(int));
-        global_pred = malloc(n * sizeof(int));
+        if (my_rank == 0)
+            fprintf(stderr, "-updates needs the dense matrix, ignoring it\n");
+        opts.update_file = NULL;
     }
-    Read_matrix(loc_mat, n, loc_n, blk_col_mpi_t, my_rank, comm);
 
-    // Bat dau do thoi gian
-    start = MPI_Wtime();
-    Dijkstra(loc_mat, loc_dist, loc_pred, loc_n, n, comm);
-    end = MPI_Wtime();
-    // ket thuc
+#ifndef HIER_MINLOC
+    if (opts.use_hier && my_rank == 0)
+        fprintf(stderr, "-hier needs 32-bit distances and vertex numbers, using MPI_Allreduce\n");
+#endif
+    if (opts.use_hier)
+    {
+        Build_hier_min(comm, &hier);
+        hier_min = &hier;
+    }
 
-    total_time = end - start;
+    /* one mode per run, the first that applies */
+    load_time = MPI_Wtime() - start;
+    if (opts.use_apsp)
+    {
+        dist_t *a;
+        double apsp_time, write_time;
+        Grid_2d grid;
 
-    /* Gather the results from Dijkstra */
-    comm_time = 0;
-    start = MPI_Wtime();
-    MPI_Gather(loc_dist, loc_n, MPI_INT, global_dist, loc_n, MPI_INT, 0, comm);
-    MPI_Gather(loc_pred, loc_n, MPI_INT, global_pred, loc_n, MPI_INT, 0, comm);
-    end = MPI_Wtime();
-    comm_time += end - start;
+        Build_grid_2d(n, p, my_rank, &grid);
+        a = malloc((size_t)grid.loc_rows * grid.loc_cols * sizeof(dist_t) + 1);
+        start = MPI_Wtime();
+        Blk_col_to_2d(loc_mat, loc_n, &grid, a, my_rank, comm);
+        free(loc_mat);
+        loc_mat = NULL;
+        Floyd_warshall_2d(a, &grid);
+        apsp_time = MPI_Wtime() - start;
+        start = MPI_Wtime();
+        Write_apsp(APSP_FILE, a, &grid, my_rank, comm);
+        write_time = MPI_Wtime() - start;
+
+        if (my_rank == 0)
+        {
+            FILE *output_file = fopen("dijkstra_output.txt", "w");
+            if (output_file != NULL)
+            {
+                fprintf(output_file, "apsp: " IDX_FMT " x " IDX_FMT " distances in %s\n",
+                        n, n, APSP_FILE);
+                fprintf(output_file, "grid: %d x %d, block " IDX_FMT "\n", grid.pr, grid.pc,
+                        grid.nb);
+                fprintf(output_file, "t_apsp: %f s\n", apsp_time);
+                fprintf(output_file, "t_write: %f s\n", write_time);
+                fprintf(output_file, "t_load: %f s\n", load_time);
+                fclose(output_file);
+            }
+        }
+        free(a);
+        Free_grid_2d(&grid);
+    }
+    else if (opts.use_server)
+        Serve_queries(loc_mat, &csr, n, loc_n, &opts, load_time, my_rank, p);
+    else if (opts.target >= 0 || opts.n_landmarks > 0)
+        P2p_queries(&loc_mat, n, loc_n, &opts, load_time, my_rank, p);
+    else if (opts.radius >= 0 || opts.knn > 0)
+        Bounded_queries(loc_mat, n, loc_n, &opts, load_time, my_rank);
+    else if (opts.update_file != NULL)
+        Dynamic_updates(loc_mat, n, loc_n, &opts, load_time, my_rank);
+    else
+        Solve_sources(&loc_mat, &csr, n, loc_n, &opts, start, my_rank, p);
+
+    if (opts.use_hier)
+        Free_hier_min(&hier);
+    if (opts.use_csr)
+        Free_loc_csr(&csr);
+    free(loc_mat);
+    free(opts.sources);
+    if (blk_col_mpi_t != MPI_DATATYPE_NULL)
+        MPI_Type_free(&blk_col_mpi_t);
+    Free_min_loc_type();
+    MPI_Finalize();
+    return 0;
+}
+
+/* The default run: the searches from all sources, in groups and batches
+ * (see Queries in the header), with the engine chosen by the options.
+ * The graph may be converted on the way (-delta, -2d), *loc_mat_p and
+ * *csr are left to the caller to free */
+void Solve_sources(dist_t **loc_mat_p, Loc_csr *csr, idx_t n, idx_t loc_n, Options *opts,
+                   double start, int my_rank, int p)
+{
+    dist_t *loc_mat = *loc_mat_p, *loc_dist, *global_dist = NULL;
+    dist_t *min_in = NULL, *min_out = NULL;
+    idx_t *loc_pred, *global_pred = NULL;
+    dist_t *grp_dist = NULL, *bat_dist = NULL;
+    idx_t *grp_pred = NULL, *bat_pred = NULL, srcs[BATCH];
+    idx_t q, r, src, m, job, n_jobs, loc_v, b;
+    int n_groups = 1, my_group = 0, grp_rank, grp_p, batch = 1, hit;
+    Grid_2d grid;
+    Sp_cache cache;
+    Path_file paths;
+    Hier_min hier, *world_hier = NULL;
+    MPI_Datatype out_dist_mpi_t, out_pred_mpi_t, row_mpi_t, pred_row_mpi_t;
+    MPI_Comm comm = MPI_COMM_WORLD, cross_comm;
+    Loc_csr out_csr;
+    long long phases = 0, rounds = 0, q_phases, q_rounds, stats[4], sum_stats[4];
+
+    double end, comm_time, total_time, load_time, times[2], max_times[2];
+    double path_time = 0;
+
+    if (opts->use_batch && (loc_mat == NULL || opts->use_multi || opts->use_delta))
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-batch needs the dense matrix, ignoring it\n");
+        opts->use_batch = 0;
+    }
+    if (opts->use_batch)
+        batch = BATCH;
+    if (opts->use_2d && (loc_mat == NULL || opts->use_batch || opts->use_multi || opts->use_delta))
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-2d is for the plain dense search, ignoring it\n");
+        opts->use_2d = 0;
+    }
+    /* a job is the search from batch sources */
+    n_jobs = (opts->n_sources + batch - 1) / batch;
+
+    /* split into groups of p / n_groups processes that each hold the
+     * whole graph, the cross communicator links the processes whose
+     * blocks are merged (and the group leaders, world ranks 0..g-1) */
+    if (opts->use_2d)
+        n_groups = 1;
+    else if (opts->groups > 0 && p % opts->groups == 0)
+        n_groups = opts->groups;
+    else
+    {
+        if (opts->groups > 0 && my_rank == 0)
+            fprintf(stderr, "-groups %d does not divide %d, choosing it\n", opts->groups, p);
+        if (loc_mat != NULL)
+            n_groups = Choose_groups(n, (double)n * n * batch,
+                                     (double)n * loc_n * sizeof(dist_t), n_jobs, p, comm);
+        else
+        {
+            MPI_Allreduce(&csr->nnz, &m, 1, MPI_IDX_T, MPI_SUM, comm);
+            n_groups = Choose_groups(n, (double)m + n,
+                                     (double)csr->nnz * (sizeof(idx_t) + sizeof(dist_t)) +
+                                         (double)n * sizeof(idx_t),
+                                     opts->n_sources, p, comm);
+        }
+    }
+    if (n_groups > 1)
+    {
+        my_group = my_rank % n_groups;
+        MPI_Comm_split(MPI_COMM_WORLD, my_group, my_rank, &comm);
+        MPI_Comm_split(MPI_COMM_WORLD, my_rank / n_groups, my_rank, &cross_comm);
+        if (loc_mat != NULL)
+            Merge_blk_cols(&loc_mat, n, loc_n, cross_comm);
+        else
+            Merge_loc_csr(csr, n, loc_n, cross_comm);
+        loc_n *= n_groups;
+    }
+    else
+        cross_comm = MPI_COMM_SELF;
+    MPI_Comm_rank(comm, &grp_rank);
+    MPI_Comm_size(comm, &grp_p);
+    if (opts->use_hier && n_groups > 1)
+    {
+        /* main set it up for all processes, the searches are per group */
+        world_hier = hier_min;
+        Build_hier_min(comm, &hier);
+        hier_min = &hier;
+    }
+
+    if (opts->use_delta)
+    {
+        /* delta-stepping relaxes from the owner of the source vertex */
+        if (!opts->use_csr)
+        {
+            Build_loc_csr(loc_mat, n, loc_n, csr);
+            free(loc_mat);
+            loc_mat = NULL;
+        }
+        Transpose_loc_csr(csr, n, loc_n, &out_csr, grp_rank, comm);
+        Free_loc_csr(csr);
+        opts->use_csr = 0;
+    }
+    else if (opts->use_multi && loc_mat == NULL)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-multi needs the dense matrix, ignoring it\n");
+        opts->use_multi = 0;
+    }
+    if (opts->use_multi)
+    {
+        min_in = malloc(loc_n * sizeof(dist_t));
+        min_out = malloc(loc_n * sizeof(dist_t));
+        Min_in_out(loc_mat, n, loc_n, min_in, min_out, grp_rank, comm);
+    }
+    if (opts->use_2d)
+    {
+        dist_t *a;
+
+        Build_grid_2d(n, p, my_rank, &grid);
+        a = malloc((size_t)grid.loc_rows * grid.loc_cols * sizeof(dist_t));
+        Blk_col_to_2d(loc_mat, loc_n, &grid, a, my_rank, comm);
+        free(loc_mat);
+        loc_mat = a;
+    }
+    load_time = MPI_Wtime() - start;
+
+    /* a grid column can have more than loc_n vertices */
+    loc_v = opts->use_2d ? grid.loc_cols : loc_n;
+    loc_dist = malloc((size_t)loc_v * batch * sizeof(dist_t));
+    loc_pred = malloc((size_t)loc_v * batch * sizeof(idx_t));
+    if (opts->use_batch)
+    {
+        bat_dist = malloc((size_t)loc_n * batch * sizeof(dist_t));
+        bat_pred = malloc((size_t)loc_n * batch * sizeof(idx_t));
+    }
+    if (loc_dist == NULL || loc_pred == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+    Init_sp_cache(&cache, opts->use_batch ? 0 : opts->cache_mb, loc_v, comm);
+
+    if (grp_rank == 0)
+    {
+        /* loc_n * p >= n when the edge list was padded */
+        grp_dist = malloc((size_t)loc_n * grp_p * batch * sizeof(dist_t));
+        grp_pred = malloc((size_t)loc_n * grp_p * batch * sizeof(idx_t));
+    }
+    if (my_rank == 0)
+    {
+        /* batch tables per group */
+        global_dist = malloc((size_t)loc_n * p * batch * sizeof(dist_t));
+        global_pred = malloc((size_t)loc_n * p * batch * sizeof(idx_t));
+    }
+
+    /* the batch local tables of a job are sent as batch rows of loc_n and
+     * land in the batch tables of loc_n * grp_p on the group leader */
+    MPI_Type_contiguous(loc_n, MPI_DIST_T, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    MPI_Type_contiguous(loc_n, MPI_IDX_T, &pred_row_mpi_t);
+    MPI_Type_commit(&pred_row_mpi_t);
+    out_dist_mpi_t = Build_strided_blk_type(batch, loc_n, loc_n * grp_p, MPI_DIST_T);
+    out_pred_mpi_t = Build_strided_blk_type(batch, loc_n, loc_n * grp_p, MPI_IDX_T);
 
     FILE *output_file = NULL;
     if (my_rank == 0)
@@ -116,6 +1036,134 @@ int main(int argc, char **argv)
             printf(" opening output file\n");
         }
     }
+    if (opts->path_file != NULL &&
+        !Open_path_file(&paths, opts->path_file, opts->path_binary, n, MPI_COMM_WORLD))
+        opts->path_file = NULL;
+
+    /* the graph stays distributed, only the sources change per job.
+     * In round r group j runs job r * n_groups + j, the search from
+     * sources job * batch .. job * batch + batch - 1 */
+    total_time = 0;
+    comm_time = 0;
+    for (r = 0; r * n_groups < n_jobs; r++)
+    {
+        job = r * n_groups + my_group;
+        times[0] = times[1] = 0;
+        if (job < n_jobs)
+        {
+            src = opts->sources[job * batch];
+
+            // Bat dau do thoi gian
+            start = MPI_Wtime();
+            hit = 0;
+            if (opts->use_batch)
+            {
+                /* the last job repeats its final source in unused slots */
+                for (b = 0; b < batch; b++)
+                    srcs[b] = opts->sources[(job * batch + b < opts->n_sources)
+                                               ? job * batch + b
+                                               : opts->n_sources - 1];
+                Dijkstra_batch(loc_mat, srcs, bat_dist, bat_pred, loc_n, n, comm);
+            }
+            else if ((hit = Sp_cache_get(&cache, src, loc_dist, loc_pred)))
+                q_phases = q_rounds = 0;
+            else if (opts->use_delta)
+                Delta_stepping(&out_csr, opts->delta, src, loc_dist, loc_pred, loc_n, comm,
+                               &q_phases, &q_rounds);
+            else if (opts->use_csr)
+                Dijkstra_csr(csr, src, loc_dist, loc_pred, loc_n, n, comm);
+            else if (opts->use_multi)
+                Dijkstra_multi(loc_mat, min_in, min_out, src, loc_dist, loc_pred, loc_n, n,
+                               comm, &q_rounds);
+            else if (opts->use_2d)
+                Dijkstra_2d(loc_mat, &grid, src, loc_dist, loc_pred);
+            else
+                Dijkstra(loc_mat, src, loc_dist, loc_pred, loc_n, n, comm);
+            if (!opts->use_batch && !hit)
+                Sp_cache_put(&cache, src, loc_dist, loc_pred);
+            end = MPI_Wtime();
+            // ket thuc
+
+            times[0] = end - start;
+            if (opts->use_delta)
+                phases += q_phases;
+            if (opts->use_delta || opts->use_multi)
+                rounds += q_rounds;
+
+            /* Gather the results from Dijkstra */
+            start = MPI_Wtime();
+            if (opts->use_batch)
+                for (loc_v = 0; loc_v < loc_n; loc_v++)
+                    for (b = 0; b < batch; b++)
+                    {
+                        loc_dist[b * loc_n + loc_v] = bat_dist[loc_v * batch + b];
+                        loc_pred[b * loc_n + loc_v] = bat_pred[loc_v * batch + b];
+                    }
+            if (opts->use_2d)
+                Gather_2d(&grid, loc_dist, loc_pred, grp_dist, grp_pred);
+            else
+            {
+                MPI_Gather(loc_dist, batch, row_mpi_t, grp_dist, 1, out_dist_mpi_t, 0, comm);
+                MPI_Gather(loc_pred, batch, pred_row_mpi_t, grp_pred, 1, out_pred_mpi_t, 0,
+                           comm);
+            }
+            end = MPI_Wtime();
+            times[1] = end - start;
+        }
+
+        /* the group leaders pass their tables on to process 0, a group
+         * without a job in the last round sends unused tables */
+        if (grp_rank == 0)
+        {
+            start = MPI_Wtime();
+            MPI_Gather(grp_dist, batch * loc_n * grp_p, MPI_DIST_T, global_dist,
+                       batch * loc_n * grp_p, MPI_DIST_T, 0, cross_comm);
+            MPI_Gather(grp_pred, batch * loc_n * grp_p, MPI_IDX_T, global_pred,
+                       batch * loc_n * grp_p, MPI_IDX_T, 0, cross_comm);
+            end = MPI_Wtime();
+            times[1] += end - start;
+            MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, 0, cross_comm);
+        }
+
+        if (my_rank == 0)
+        {
+            total_time += max_times[0];
+            comm_time += max_times[1];
+            for (q = r * n_groups * batch;
+                 q < (r + 1) * n_groups * batch && q < opts->n_sources; q++)
+            {
+                src = opts->sources[q];
+                Print_dists(&global_dist[(size_t)(q - r * n_groups * batch) * loc_n * grp_p],
+                            src, n, output_file);
+                if (opts->path_file == NULL)
+                    Print_paths(&global_pred[(size_t)(q - r * n_groups * batch) * loc_n * grp_p],
+                                src, n, output_file);
+            }
+        }
+        if (opts->path_file != NULL)
+        {
+            start = MPI_Wtime();
+            for (q = r * n_groups * batch;
+                 q < (r + 1) * n_groups * batch && q < opts->n_sources; q++)
+                Write_paths_par((my_rank == 0) ? &global_pred[(size_t)(q - r * n_groups * batch) *
+                                                              loc_n * grp_p]
+                                               : NULL,
+                                opts->sources[q], n, &paths, MPI_COMM_WORLD);
+            path_time += MPI_Wtime() - start;
+        }
+    }
+    if (opts->path_file != NULL)
+        Close_path_file(&paths);
+    if (grp_rank == 0)
+    {
+        stats[0] = phases;
+        stats[1] = rounds;
+        stats[2] = cache.hits;
+        stats[3] = cache.misses;
+        MPI_Reduce(stats, sum_stats, 4, MPI_LONG_LONG, MPI_SUM, 0, cross_comm);
+        phases = sum_stats[0];
+        rounds = sum_stats[1];
+    }
 
     FILE *dijkstra_graph_nT = NULL;
     if (my_rank == 0)
@@ -152,13 +1200,35 @@ int main(int argc, char **argv)
     /* Print results */
     if (my_rank == 0)
     {
-        Print_dists(global_dist, n, output_file);
-        Print_paths(global_pred, n, output_file);
         fprintf(output_file, "t_w_comm: %f s\n", total_time);
         fprintf(output_file, "t_wo_comm: %f s\n", total_time - comm_time);
+        fprintf(output_file, "t_load: %f s\n", load_time);
+        if (opts->path_file != NULL)
+            fprintf(output_file, "t_paths: %f s in %s\n", path_time, opts->path_file);
+        if (opts->n_sources > 1)
+            fprintf(output_file, "queries: " IDX_FMT ", t_per_query: %f s\n",
+                    opts->n_sources, total_time / opts->n_sources);
+        if (n_groups > 1)
+            fprintf(output_file, "groups: %d x %d processes\n", n_groups, grp_p);
+        if (opts->use_2d)
+            fprintf(output_file, "grid: %d x %d processes\n", grid.pr, grid.pc);
+        if (opts->use_hier)
+            fprintf(output_file, "minloc: node + leaders\n");
+#ifdef _OPENMP
+        if (omp_get_max_threads() > 1)
+            fprintf(output_file, "threads: %d per process\n", omp_get_max_threads());
+#endif
+        if (opts->use_delta)
+            fprintf(output_file, "delta-stepping: %lld buckets, %lld rounds\n",
+                    phases, rounds);
+        if (opts->use_multi)
+            fprintf(output_file, "multi-settle: %lld rounds\n", rounds);
+        if (cache.cap > 0)
+            fprintf(output_file, "cache: %lld hits, %lld misses, %d trees per group\n",
+                    sum_stats[2], sum_stats[3], cache.cap);
         fclose(output_file);
 
-        fprintf(dijkstra_graph_nT, "%d, ", n);                      // so luong mau
+        fprintf(dijkstra_graph_nT, IDX_FMT ", ", n);                // so luong mau
         fprintf(dijkstra_graph_nT, "%f, ", total_time);             // t_w_comm
         fprintf(dijkstra_graph_nT, "%f\n", total_time - comm_time); // t_wo_comm:
         fclose(dijkstra_graph_nT);
@@ -171,224 +1241,4166 @@ int main(int argc, char **argv)
         free(global_dist);
         free(global_pred);
     }
-    free(loc_mat);
+    free(grp_dist);
+    free(grp_pred);
+    free(bat_dist);
+    free(bat_pred);
+    MPI_Type_free(&row_mpi_t);
+    MPI_Type_free(&pred_row_mpi_t);
+    MPI_Type_free(&out_dist_mpi_t);
+    MPI_Type_free(&out_pred_mpi_t);
+    if (n_groups > 1)
+    {
+        MPI_Comm_free(&comm);
+        MPI_Comm_free(&cross_comm);
+    }
+    if (opts->use_2d)
+        Free_grid_2d(&grid);
+    if (opts->use_hier && n_groups > 1)
+    {
+        Free_hier_min(&hier);
+        hier_min = world_hier;
+    }
+    if (opts->use_delta)
+        Free_loc_csr(&out_csr);
+    Free_sp_cache(&cache);
+    free(min_in);
+    free(min_out);
     free(loc_pred);
     free(loc_dist);
-    MPI_Type_free(&blk_col_mpi_t);
-    MPI_Finalize();
-    return 0;
+    *loc_mat_p = loc_mat;
 }
 
-int Read_n(int my_rank, MPI_Comm comm)
+void Parse_args(int argc, char **argv, Options *opts)
 {
-    int n;
+    int i;
 
-    if (my_rank == 0)
-        scanf("%d", &n);
-
-    MPI_Bcast(&n, 1, MPI_INT, 0, comm);
-    return n;
+    opts->use_csr = 0;
+    opts->edge_file = NULL;
+    opts->bin_file = NULL;
+    opts->use_delta = 0;
+    opts->delta = 0;
+    opts->use_multi = 0;
+    opts->sources = NULL;
+    opts->n_sources = 0;
+    opts->query_file = NULL;
+    opts->groups = 0;
+    opts->use_batch = 0;
+    opts->use_apsp = 0;
+    opts->use_2d = 0;
+    opts->use_hier = 0;
+    opts->bench_iters = 0;
+    opts->target = -1;
+    opts->use_bidir = 0;
+    opts->potential_file = NULL;
+    opts->use_server = 0;
+    opts->socket_path = NULL;
+    opts->cache_mb = 0;
+    opts->n_landmarks = 0;
+    opts->alt_file = NULL;
+    opts->update_file = NULL;
+    opts->radius = -1;
+    opts->knn = 0;
+    opts->path_file = NULL;
+    opts->path_binary = 0;
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-csr") == 0)
+            opts->use_csr = 1;
+        else if (strcmp(argv[i], "-edges") == 0 && i + 1 < argc)
+            opts->edge_file = argv[++i];
+        else if (strcmp(argv[i], "-bin") == 0 && i + 1 < argc)
+            opts->bin_file = argv[++i];
+        else if (strcmp(argv[i], "-multi") == 0)
+            opts->use_multi = 1;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            opts->sources = realloc(opts->sources, (opts->n_sources + 1) * sizeof(idx_t));
+            opts->sources[opts->n_sources++] = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-queries") == 0 && i + 1 < argc)
+            opts->query_file = argv[++i];
+        else if (strcmp(argv[i], "-batch") == 0)
+            opts->use_batch = 1;
+        else if (strcmp(argv[i], "-apsp") == 0)
+            opts->use_apsp = 1;
+        else if (strcmp(argv[i], "-2d") == 0)
+            opts->use_2d = 1;
+        else if (strcmp(argv[i], "-hier") == 0)
+            opts->use_hier = 1;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opts->target = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-bidir") == 0)
+            opts->use_bidir = 1;
+        else if (strcmp(argv[i], "-landmarks") == 0 && i + 1 < argc)
+            opts->n_landmarks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-alt") == 0 && i + 1 < argc)
+            opts->alt_file = argv[++i];
+        else if (strcmp(argv[i], "-radius") == 0 && i + 1 < argc)
+            opts->radius = atof(argv[++i]);
+        else if (strcmp(argv[i], "-knn") == 0 && i + 1 < argc)
+            opts->knn = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-paths") == 0 && i + 1 < argc)
+            opts->path_file = argv[++i];
+        else if (strcmp(argv[i], "-paths-bin") == 0 && i + 1 < argc)
+        {
+            opts->path_file = argv[++i];
+            opts->path_binary = 1;
+        }
+        else if (strcmp(argv[i], "-updates") == 0 && i + 1 < argc)
+            opts->update_file = argv[++i];
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+            opts->cache_mb = atof(argv[++i]);
+        else if (strcmp(argv[i], "-server") == 0)
+            opts->use_server = 1;
+        else if (strcmp(argv[i], "-socket") == 0 && i + 1 < argc)
+        {
+            opts->use_server = 1;
+            opts->socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-potential") == 0 && i + 1 < argc)
+            opts->potential_file = argv[++i];
+        else if (strcmp(argv[i], "-minloc-bench") == 0 && i + 1 < argc)
+            opts->bench_iters = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-groups") == 0 && i + 1 < argc)
+            opts->groups = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-delta") == 0 && i + 1 < argc)
+        {
+            opts->use_delta = 1;
+            opts->delta = atof(argv[++i]);
+        }
+        else
+            fprintf(stderr, "Ignoring unknown option %s\n", argv[i]);
+    }
 }
 
-MPI_Datatype Build_blk_col_type(int n, int loc_n)
+/* Appends the source vertices in path to opts->sources.  Process 0
+ * reads the file and broadcasts them */
+void Read_sources(char *path, Options *opts, int my_rank, MPI_Comm comm)
 {
-    MPI_Aint lb, extent;
-    MPI_Datatype block_mpi_t;
-    MPI_Datatype first_bc_mpi_t;
-    MPI_Datatype blk_col_mpi_t;
-
-    MPI_Type_contiguous(loc_n, MPI_INT, &block_mpi_t);
-    MPI_Type_get_extent(block_mpi_t, &lb, &extent);
+    FILE *fp;
+    idx_t v, count = 0, cap = 16, *buf;
 
-    MPI_Type_vector(n, loc_n, n, MPI_INT, &first_bc_mpi_t);
+    buf = malloc(cap * sizeof(idx_t));
+    if (my_rank == 0)
+    {
+        fp = fopen(path, "r");
+        if (fp == NULL)
+            fprintf(stderr, "Can't open query file %s\n", path);
+        else
+        {
+            while (fscanf(fp, IDX_FMT, &v) == 1)
+            {
+                if (count == cap)
+                {
+                    cap *= 2;
+                    buf = realloc(buf, cap * sizeof(idx_t));
+                }
+                buf[count++] = v;
+            }
+            fclose(fp);
+        }
+    }
+    MPI_Bcast(&count, 1, MPI_IDX_T, 0, comm);
+    if (my_rank != 0)
+        buf = realloc(buf, (count + 1) * sizeof(idx_t));
+    MPI_Bcast(buf, count, MPI_IDX_T, 0, comm);
 
-    MPI_Type_create_resized(first_bc_mpi_t, lb, extent, &blk_col_mpi_t);
+    opts->sources = realloc(opts->sources, (opts->n_sources + count + 1) * sizeof(idx_t));
+    memcpy(&opts->sources[opts->n_sources], buf, count * sizeof(idx_t));
+    opts->n_sources += count;
+    free(buf);
+}
 
-    MPI_Type_commit(&blk_col_mpi_t);
+/* Number of groups g for n_sources sources on p processes: the divisor
+ * of p with the smallest ceil(n_sources / g) * (n * alpha * log2(p / g)
+ * + work / (p / g) * beta) among those that keep loc_bytes * g (the
+ * merged block) under GROUP_MEM_LIMIT.  alpha is the time of a MINLOC
+ * reduction per tree level and beta of relaxing one entry, both
+ * measured here and agreed on with their maximum over the processes */
+int Choose_groups(idx_t n, double work, double loc_bytes, idx_t n_sources, int p,
+                  MPI_Comm comm)
+{
+    const int reps = 20, len = 4096;
+    dist_t *row, *dist;
+    idx_t *pred, i;
+    int *known, g, best_g = 1, q, levels, rep;
+    double t[2], t_max[2], cost, best_cost = -1, max_bytes;
+    Dist_loc my_min, glbl_min;
 
-    MPI_Type_free(&block_mpi_t);
-    MPI_Type_free(&first_bc_mpi_t);
+    if (p == 1 || n_sources <= 1)
+        return 1;
 
-    return blk_col_mpi_t;
-}
+    my_min.dist = 0;
+    MPI_Comm_rank(comm, &q);
+    my_min.v = q;
+    MPI_Barrier(comm);
+    t[0] = MPI_Wtime();
+    for (rep = 0; rep < reps; rep++)
+        MPI_Allreduce(&my_min, &glbl_min, 1, dist_loc_mpi_t, min_loc_op, comm);
+    for (levels = 0; (1 << levels) < p; levels++)
+        ;
+    t[0] = (MPI_Wtime() - t[0]) / reps / levels;
 
-void Read_matrix(int loc_mat[], int n, int loc_n,
-                 MPI_Datatype blk_col_mpi_t, int my_rank, MPI_Comm comm)
-{
-    int *mat = NULL;
-    int i = 0;
-    int j = 0;
-    if (my_rank == 0)
+    row = malloc(len * sizeof(dist_t));
+    dist = malloc(len * sizeof(dist_t));
+    pred = malloc(len * sizeof(idx_t));
+    known = malloc(len * sizeof(int));
+    for (i = 0; i < len; i++)
     {
-        mat = malloc(n * n * sizeof(int));
-        for (i = 0; i < n; i++)
-            for (j = 0; j < n; j++)
-                scanf("%d", &mat[i * n + j]);
+        row[i] = 1;
+        dist[i] = DIST_INF;
+        known[i] = 0;
     }
+    t[1] = MPI_Wtime();
+    for (rep = 0; rep < reps; rep++)
+        Relax_find_min(row, rep, 0, dist, pred, known, len);
+    t[1] = (MPI_Wtime() - t[1]) / reps / len;
+    free(row);
+    free(dist);
+    free(pred);
+    free(known);
 
-    double start = MPI_Wtime();
-    MPI_Scatter(mat, 1, blk_col_mpi_t, loc_mat, n * loc_n, MPI_INT, 0, comm);
-    double end = MPI_Wtime();
+    MPI_Allreduce(t, t_max, 2, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&loc_bytes, &max_bytes, 1, MPI_DOUBLE, MPI_MAX, comm);
 
-    if (my_rank == 0)
+    for (g = 1; g <= p && g <= n_sources; g++)
     {
-        free(mat);
+        if (p % g != 0 || (g > 1 && max_bytes * g > GROUP_MEM_LIMIT))
+            continue;
+        q = p / g;
+        for (levels = 0; (1 << levels) < q; levels++)
+            ;
+        cost = (double)((n_sources + g - 1) / g) *
+               (n * t_max[0] * levels + work / q * t_max[1]);
+        if (best_cost < 0 || cost < best_cost)
+        {
+            best_cost = cost;
+            best_g = g;
+        }
     }
+    return best_g;
 }
 
-void Dijkstra_Init(int loc_mat[], int loc_pred[], int loc_dist[], int loc_known[],
-                   int my_rank, int loc_n)
+/* rows blocks of loc_n elements stride elements apart, resized to
+ * loc_n elements so consecutive ones interleave: the column block of a
+ * rows x stride matrix like Build_blk_col_type */
+MPI_Datatype Build_strided_blk_type(idx_t rows, idx_t loc_n, idx_t stride,
+                                   MPI_Datatype elem_mpi_t)
 {
-    int loc_v;
+    MPI_Aint lb, extent;
+    MPI_Datatype vec_mpi_t, blk_mpi_t;
 
-    if (my_rank == 0)
-        loc_known[0] = 1;
-    else
-        loc_known[0] = 0;
+    MPI_Type_get_extent(elem_mpi_t, &lb, &extent);
+    MPI_Type_vector(rows, loc_n, stride, elem_mpi_t, &vec_mpi_t);
+    MPI_Type_create_resized(vec_mpi_t, 0, loc_n * extent, &blk_mpi_t);
+    MPI_Type_commit(&blk_mpi_t);
+    MPI_Type_free(&vec_mpi_t);
 
-    for (loc_v = 1; loc_v < loc_n; loc_v++)
-        loc_known[loc_v] = 0;
+    return blk_mpi_t;
+}
 
-    for (loc_v = 0; loc_v < loc_n; loc_v++)
+/* Replaces the n x loc_n column block by the n x (g * loc_n) block of
+ * the g processes of cross_comm, in rank order.  The receive type puts
+ * each member's columns next to each other in every row */
+void Merge_blk_cols(dist_t **loc_mat_p, idx_t n, idx_t loc_n, MPI_Comm cross_comm)
+{
+    int g;
+    dist_t *merged;
+    MPI_Datatype row_mpi_t, blk_mpi_t;
+
+    MPI_Comm_size(cross_comm, &g);
+    merged = malloc((size_t)n * loc_n * g * sizeof(dist_t));
+    if (merged == NULL)
     {
-        loc_dist[loc_v] = loc_mat[0 * loc_n + loc_v];
-        loc_pred[loc_v] = 0;
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
     }
+
+    MPI_Type_contiguous(loc_n, MPI_DIST_T, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    blk_mpi_t = Build_strided_blk_type(n, loc_n, loc_n * g, MPI_DIST_T);
+
+    MPI_Allgather(*loc_mat_p, n, row_mpi_t, merged, 1, blk_mpi_t, cross_comm);
+
+    MPI_Type_free(&row_mpi_t);
+    MPI_Type_free(&blk_mpi_t);
+    free(*loc_mat_p);
+    *loc_mat_p = merged;
 }
 
-void Dijkstra(int loc_mat[], int loc_dist[], int loc_pred[], int loc_n, int n,
-              MPI_Comm comm)
+/* Same as Merge_blk_cols for the column block CSR: row u of the result
+ * is row u of every member in rank order, columns shifted by
+ * rank * loc_n */
+void Merge_loc_csr(Loc_csr *csr, idx_t n, idx_t loc_n, MPI_Comm cross_comm)
 {
+    int g, j, *counts, *displs;
+    idx_t u, e, k, *all_row_ptr, *all_nnz, *col_idx;
+    dist_t *weight;
+    Loc_csr merged;
 
-    int i, loc_v, loc_u, glbl_u, new_dist, my_rank, dist_glbl_u;
-    int *loc_known;
-    int my_min[2];
-    int glbl_min[2];
-    double start, end;
+    MPI_Comm_size(cross_comm, &g);
+    all_row_ptr = malloc((size_t)g * (n + 1) * sizeof(idx_t));
+    all_nnz = malloc(g * sizeof(idx_t));
+    counts = malloc(g * sizeof(int));
+    displs = malloc(g * sizeof(int));
+    MPI_Allgather(csr->row_ptr, n + 1, MPI_IDX_T, all_row_ptr, n + 1, MPI_IDX_T, cross_comm);
+    MPI_Allgather(&csr->nnz, 1, MPI_IDX_T, all_nnz, 1, MPI_IDX_T, cross_comm);
 
-    MPI_Comm_rank(comm, &my_rank);
-    loc_known = malloc(loc_n * sizeof(int));
+    merged.nnz = 0;
+    for (j = 0; j < g; j++)
+    {
+        counts[j] = all_nnz[j];
+        displs[j] = merged.nnz;
+        merged.nnz += all_nnz[j];
+    }
+    col_idx = malloc((merged.nnz + 1) * sizeof(idx_t));
+    weight = malloc((merged.nnz + 1) * sizeof(dist_t));
+    MPI_Allgatherv(csr->col_idx, csr->nnz, MPI_IDX_T, col_idx, counts, displs,
+                   MPI_IDX_T, cross_comm);
+    MPI_Allgatherv(csr->weight, csr->nnz, MPI_DIST_T, weight, counts, displs,
+                   MPI_DIST_T, cross_comm);
+
+    merged.row_ptr = malloc((n + 1) * sizeof(idx_t));
+    merged.col_idx = malloc((merged.nnz + 1) * sizeof(idx_t));
+    merged.weight = malloc((merged.nnz + 1) * sizeof(dist_t));
+    k = 0;
+    merged.row_ptr[0] = 0;
+    for (u = 0; u < n; u++)
+    {
+        for (j = 0; j < g; j++)
+            for (e = all_row_ptr[(size_t)j * (n + 1) + u];
+                 e < all_row_ptr[(size_t)j * (n + 1) + u + 1]; e++)
+            {
+                merged.col_idx[k] = col_idx[displs[j] + e] + j * loc_n;
+                merged.weight[k] = weight[displs[j] + e];
+                k++;
+            }
+        merged.row_ptr[u + 1] = k;
+    }
+
+    free(all_row_ptr);
+    free(all_nnz);
+    free(counts);
+    free(displs);
+    free(col_idx);
+    free(weight);
+    Free_loc_csr(csr);
+    *csr = merged;
+}
+
+void Build_min_loc_type(void)
+{
+#if !defined(IDX_INT64) && !defined(DIST_INT64) && !defined(DIST_FLOAT)
+    dist_loc_mpi_t = MPI_2INT;
+    min_loc_op = MPI_MINLOC;
+#elif !defined(IDX_INT64) && defined(DIST_FLOAT)
+    dist_loc_mpi_t = MPI_FLOAT_INT;
+    min_loc_op = MPI_MINLOC;
+#else
+    int blk_lens[2] = {1, 1};
+    MPI_Aint displs[2] = {offsetof(Dist_loc, dist), offsetof(Dist_loc, v)};
+    MPI_Datatype types[2] = {MPI_DIST_T, MPI_IDX_T};
+    MPI_Datatype tmp_mpi_t;
+
+    MPI_Type_create_struct(2, blk_lens, displs, types, &tmp_mpi_t);
+    MPI_Type_create_resized(tmp_mpi_t, 0, sizeof(Dist_loc), &dist_loc_mpi_t);
+    MPI_Type_commit(&dist_loc_mpi_t);
+    MPI_Type_free(&tmp_mpi_t);
+    MPI_Op_create(Min_loc, 1, &min_loc_op);
+#endif
+}
+
+void Free_min_loc_type(void)
+{
+    if (min_loc_op != MPI_MINLOC)
+    {
+        MPI_Op_free(&min_loc_op);
+        MPI_Type_free(&dist_loc_mpi_t);
+    }
+}
+
+/* MPI_MINLOC for Dist_loc: smaller distance, then smaller vertex */
+void Min_loc(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    Dist_loc *a = in, *b = inout;
+    int i;
+
+    for (i = 0; i < *len; i++)
+        if (a[i].dist < b[i].dist || (a[i].dist == b[i].dist && a[i].v < b[i].v))
+            b[i] = a[i];
+}
+
+#ifdef HIER_MINLOC
+/* distance bits above vertex + 1: nonnegative ints and floats order like
+ * their bits, and v = -1 (no candidate) sorts first as MINLOC does */
+static inline uint64_t Pack_min(Dist_loc *m)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &m->dist, sizeof(bits));
+    return ((uint64_t)bits << 32) | (uint32_t)(m->v + 1);
+}
+
+static inline void Unpack_min(uint64_t key, Dist_loc *m)
+{
+    uint32_t bits = key >> 32;
+
+    memcpy(&m->dist, &bits, sizeof(bits));
+    m->v = (idx_t)(uint32_t)key - 1;
+}
+
+static inline uint64_t *Hier_line(Hier_min *h, int i)
+{
+    return (uint64_t *)(h->base + (size_t)i * HIER_LINE);
+}
+
+/* waits until line[1] holds seq, yielding after HIER_SPINS tries so that
+ * oversubscribed nodes still make progress */
+static inline void Spin_wait(uint64_t *line, uint64_t seq)
+{
+    int spins = 0;
+
+    while (__atomic_load_n(&line[1], __ATOMIC_ACQUIRE) != seq)
+        if (++spins > HIER_SPINS)
+            sched_yield();
+}
+#endif
+
+void Build_hier_min(MPI_Comm comm, Hier_min *h)
+{
+#ifdef HIER_MINLOC
+    int rank, disp_unit;
+    MPI_Aint size;
+    char *my_base;
+
+    MPI_Comm_rank(comm, &rank);
+    h->comm = comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &h->node_comm);
+    MPI_Comm_rank(h->node_comm, &h->node_rank);
+    MPI_Comm_size(h->node_comm, &h->node_size);
+    MPI_Comm_split(comm, (h->node_rank == 0) ? 0 : MPI_UNDEFINED, rank, &h->leader_comm);
+
+    /* all lines live in the segment of node rank 0 */
+    MPI_Win_allocate_shared((h->node_rank == 0) ? (MPI_Aint)(h->node_size + 1) * HIER_LINE : 0,
+                            HIER_LINE, MPI_INFO_NULL, h->node_comm, &my_base, &h->win);
+    MPI_Win_shared_query(h->win, 0, &size, &disp_unit, &h->base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, h->win);
+    if (h->node_rank == 0)
+        memset(h->base, 0, (size_t)(h->node_size + 1) * HIER_LINE);
+    MPI_Win_sync(h->win);
+    MPI_Barrier(h->node_comm);
+    h->seq = 0;
+#else
+    (void)comm;
+    h->comm = MPI_COMM_NULL;
+#endif
+}
+
+void Free_hier_min(Hier_min *h)
+{
+#ifdef HIER_MINLOC
+    MPI_Win_unlock_all(h->win);
+    MPI_Win_free(&h->win);
+    if (h->leader_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&h->leader_comm);
+    MPI_Comm_free(&h->node_comm);
+#else
+    (void)h;
+#endif
+}
+
+/* As many trees of loc_len vertices as fit in mb megabytes on every
+ * process of comm, none if mb is 0 */
+void Init_sp_cache(Sp_cache *c, double mb, idx_t loc_len, MPI_Comm comm)
+{
+    double cap;
+    int i;
+
+    cap = mb * 1048576.0 / ((double)loc_len * (sizeof(dist_t) + sizeof(idx_t)));
+    c->cap = (cap > INT_MAX) ? INT_MAX : (int)cap;
+    MPI_Allreduce(MPI_IN_PLACE, &c->cap, 1, MPI_INT, MPI_MIN, comm);
+    c->loc_len = loc_len;
+    c->used = 0;
+    c->clock = c->hits = c->misses = 0;
+    c->src = NULL;
+    c->stamp = NULL;
+    c->dist = NULL;
+    c->pred = NULL;
+    if (c->cap == 0)
+        return;
+    c->src = malloc(c->cap * sizeof(idx_t));
+    c->stamp = malloc(c->cap * sizeof(long long));
+    c->dist = malloc(c->cap * sizeof(dist_t *));
+    c->pred = malloc(c->cap * sizeof(idx_t *));
+    for (i = 0; i < c->cap; i++)
+    {
+        c->dist[i] = NULL;
+        c->pred[i] = NULL;
+    }
+}
+
+/* 1 and the tree of src in loc_dist and loc_pred if it is cached */
+int Sp_cache_get(Sp_cache *c, idx_t src, dist_t loc_dist[], idx_t loc_pred[])
+{
+    int i;
+
+    if (c->cap == 0)
+        return 0;
+    for (i = 0; i < c->used; i++)
+        if (c->src[i] == src)
+        {
+            memcpy(loc_dist, c->dist[i], c->loc_len * sizeof(dist_t));
+            memcpy(loc_pred, c->pred[i], c->loc_len * sizeof(idx_t));
+            c->stamp[i] = ++c->clock;
+            c->hits++;
+            return 1;
+        }
+    c->misses++;
+    return 0;
+}
+
+/* Keep the tree of src, in a free slot or in place of the least
+ * recently used one */
+void Sp_cache_put(Sp_cache *c, idx_t src, dist_t loc_dist[], idx_t loc_pred[])
+{
+    int i, slot;
+
+    if (c->cap == 0)
+        return;
+    if (c->used < c->cap)
+    {
+        slot = c->used++;
+        c->dist[slot] = malloc(c->loc_len * sizeof(dist_t));
+        c->pred[slot] = malloc(c->loc_len * sizeof(idx_t));
+    }
+    else
+        for (i = 1, slot = 0; i < c->used; i++)
+            if (c->stamp[i] < c->stamp[slot])
+                slot = i;
+    c->src[slot] = src;
+    c->stamp[slot] = ++c->clock;
+    memcpy(c->dist[slot], loc_dist, c->loc_len * sizeof(dist_t));
+    memcpy(c->pred[slot], loc_pred, c->loc_len * sizeof(idx_t));
+}
+
+void Free_sp_cache(Sp_cache *c)
+{
+    int i;
+
+    for (i = 0; i < c->used; i++)
+    {
+        free(c->dist[i]);
+        free(c->pred[i]);
+    }
+    free(c->src);
+    free(c->stamp);
+    free(c->dist);
+    free(c->pred);
+}
+
+/* MINLOC of my_min over comm, in two levels when -hier set it up for
+ * comm and as one MPI_Allreduce otherwise */
+void Min_loc_allreduce(Dist_loc *my_min, Dist_loc *glbl_min, MPI_Comm comm)
+{
+#ifdef HIER_MINLOC
+    Hier_min *h = hier_min;
+    uint64_t key, other, *line;
+    int i, leaders;
+
+    if (h != NULL && h->comm == comm)
+    {
+        h->seq++;
+        key = Pack_min(my_min);
+        if (h->node_rank != 0)
+        {
+            line = Hier_line(h, h->node_rank);
+            __atomic_store_n(&line[0], key, __ATOMIC_RELAXED);
+            __atomic_store_n(&line[1], h->seq, __ATOMIC_RELEASE);
+            line = Hier_line(h, h->node_size);
+            Spin_wait(line, h->seq);
+            key = __atomic_load_n(&line[0], __ATOMIC_RELAXED);
+        }
+        else
+        {
+            for (i = 1; i < h->node_size; i++)
+            {
+                line = Hier_line(h, i);
+                Spin_wait(line, h->seq);
+                other = __atomic_load_n(&line[0], __ATOMIC_RELAXED);
+                if (other < key)
+                    key = other;
+            }
+            MPI_Comm_size(h->leader_comm, &leaders);
+            if (leaders > 1)
+            {
+                other = key;
+                MPI_Allreduce(&other, &key, 1, MPI_UINT64_T, MPI_MIN, h->leader_comm);
+            }
+            line = Hier_line(h, h->node_size);
+            __atomic_store_n(&line[0], key, __ATOMIC_RELAXED);
+            __atomic_store_n(&line[1], h->seq, __ATOMIC_RELEASE);
+        }
+        Unpack_min(key, glbl_min);
+        return;
+    }
+#endif
+    MPI_Allreduce(my_min, glbl_min, 1, dist_loc_mpi_t, min_loc_op, comm);
+}
+
+/* -minloc-bench: iters MINLOCs of changing candidates flat and in two
+ * levels, checks they agree and prints the time per call (max over the
+ * processes) */
+void Bench_min_loc(int iters, int my_rank, MPI_Comm comm)
+{
+#ifdef HIER_MINLOC
+    Hier_min h;
+    Dist_loc my_min, flat_min, two_min;
+    double t[2], t_max[2];
+    int it, p, nodes, is_leader, bad = 0, all_bad;
+
+    MPI_Comm_size(comm, &p);
+    Build_hier_min(comm, &h);
+    is_leader = (h.node_rank == 0);
+    MPI_Allreduce(&is_leader, &nodes, 1, MPI_INT, MPI_SUM, comm);
+
+    MPI_Barrier(comm);
+    t[0] = MPI_Wtime();
+    for (it = 0; it < iters; it++)
+    {
+        my_min.dist = (dist_t)(((long long)my_rank * 7919 + (long long)it * 104729) % 1000);
+        my_min.v = my_rank;
+        MPI_Allreduce(&my_min, &flat_min, 1, dist_loc_mpi_t, min_loc_op, comm);
+    }
+    t[0] = (MPI_Wtime() - t[0]) / iters;
+
+    hier_min = &h;
+    MPI_Barrier(comm);
+    t[1] = MPI_Wtime();
+    for (it = 0; it < iters; it++)
+    {
+        my_min.dist = (dist_t)(((long long)my_rank * 7919 + (long long)it * 104729) % 1000);
+        my_min.v = my_rank;
+        Min_loc_allreduce(&my_min, &two_min, comm);
+    }
+    t[1] = (MPI_Wtime() - t[1]) / iters;
+    hier_min = NULL;
+
+    /* one more round of each to compare the answers */
+    for (it = 0; it < 16 && it < iters; it++)
+    {
+        my_min.dist = (dist_t)((my_rank * 31 + it * 17) % 5);
+        my_min.v = (it % 2 && my_rank % 3 == 0) ? -1 : my_rank;
+        if (my_min.v == -1)
+            my_min.dist = DIST_INF;
+        MPI_Allreduce(&my_min, &flat_min, 1, dist_loc_mpi_t, min_loc_op, comm);
+        hier_min = &h;
+        Min_loc_allreduce(&my_min, &two_min, comm);
+        hier_min = NULL;
+        bad += (flat_min.dist != two_min.dist || flat_min.v != two_min.v);
+    }
+
+    MPI_Reduce(t, t_max, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&bad, &all_bad, 1, MPI_INT, MPI_SUM, 0, comm);
+    if (my_rank == 0)
+        printf("minloc: %d processes on %d nodes, flat %.2f us, node + leaders %.2f us, %s\n",
+               p, nodes, t_max[0] * 1e6, t_max[1] * 1e6, all_bad ? "MISMATCH" : "same results");
+    Free_hier_min(&h);
+#else
+    (void)iters;
+    (void)comm;
+    if (my_rank == 0)
+        fprintf(stderr, "-minloc-bench needs 32-bit distances and vertex numbers\n");
+#endif
+}
+
+idx_t Read_n(int my_rank, MPI_Comm comm)
+{
+    idx_t n;
+
+    if (my_rank == 0)
+        scanf(IDX_FMT, &n);
+
+    MPI_Bcast(&n, 1, MPI_IDX_T, 0, comm);
+    return n;
+}
+
+MPI_Datatype Build_blk_col_type(idx_t n, idx_t loc_n, MPI_Datatype elem_mpi_t)
+{
+    MPI_Aint lb, extent;
+    MPI_Datatype block_mpi_t;
+    MPI_Datatype first_bc_mpi_t;
+    MPI_Datatype blk_col_mpi_t;
+
+    MPI_Type_contiguous(loc_n, elem_mpi_t, &block_mpi_t);
+    MPI_Type_get_extent(block_mpi_t, &lb, &extent);
+
+    MPI_Type_vector(n, loc_n, n, elem_mpi_t, &first_bc_mpi_t);
+
+    MPI_Type_create_resized(first_bc_mpi_t, lb, extent, &blk_col_mpi_t);
+
+    MPI_Type_commit(&blk_col_mpi_t);
+
+    MPI_Type_free(&block_mpi_t);
+    MPI_Type_free(&first_bc_mpi_t);
+
+    return blk_col_mpi_t;
+}
+
+void Read_matrix(dist_t loc_mat[], idx_t n, idx_t loc_n,
+                 MPI_Datatype blk_col_mpi_t, int my_rank, MPI_Comm comm)
+{
+    dist_t *mat = NULL;
+    size_t i = 0;
+    MPI_Datatype row_mpi_t;
+    if (my_rank == 0)
+    {
+        mat = malloc((size_t)n * n * sizeof(dist_t));
+        for (i = 0; i < (size_t)n * n; i++)
+        {
+            scanf(DIST_SCAN_FMT, &mat[i]);
+            if (mat[i] >= INFINITY)
+                mat[i] = DIST_INF;
+        }
+    }
+
+    /* receive n rows of loc_n so the count fits in an int */
+    MPI_Type_contiguous(loc_n, MPI_DIST_T, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    MPI_Scatter(mat, 1, blk_col_mpi_t, loc_mat, n, row_mpi_t, 0, comm);
+    MPI_Type_free(&row_mpi_t);
+
+    if (my_rank == 0)
+    {
+        free(mat);
+    }
+}
+
+MPI_File Open_bin_matrix(char *path, idx_t *n_p, int my_rank, MPI_Comm comm)
+{
+    MPI_File fh;
+    char header[BIN_HEADER_SIZE];
+    int elem_size;
+    long long n;
+
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "Error opening binary matrix %s\n", path);
+        MPI_Abort(comm, -1);
+    }
+    MPI_File_read_at_all(fh, 0, header, BIN_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+    memcpy(&elem_size, header + 4, sizeof(int));
+    memcpy(&n, header + 8, sizeof(long long));
+    if (memcmp(header, BIN_MAGIC, 4) != 0 || elem_size != 4 || n <= 0)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "%s is not a binary matrix file\n", path);
+        MPI_Abort(comm, -1);
+    }
+
+    *n_p = (idx_t)n;
+    return fh;
+}
+
+void Read_bin_matrix(MPI_File fh, dist_t loc_mat[], idx_t n, idx_t loc_n,
+                     MPI_Datatype blk_col_mpi_t, int my_rank)
+{
+    MPI_Datatype row_mpi_t;
+    int *raw = (int *)loc_mat;
+    size_t i;
+
+    /* the view starts at this process' first column, one instance of the
+     * block column type then covers exactly its n x loc_n block */
+    MPI_File_set_view(fh, BIN_HEADER_SIZE + (MPI_Offset)my_rank * loc_n * sizeof(int),
+                      MPI_INT, blk_col_mpi_t, "native", MPI_INFO_NULL);
+
+    /* count in rows so n * loc_n does not have to fit in an int */
+    MPI_Type_contiguous(loc_n, MPI_INT, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    MPI_File_read_at_all(fh, 0, raw, n, row_mpi_t, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row_mpi_t);
+
+    /* widen the int32 weights in place, back to front so that no weight
+     * is overwritten before it is converted */
+    for (i = (size_t)n * loc_n; i-- > 0;)
+        loc_mat[i] = (raw[i] >= INFINITY) ? DIST_INF : (dist_t)raw[i];
+}
+
+void Dijkstra_Init(dist_t loc_mat[], idx_t src, idx_t loc_pred[], dist_t loc_dist[],
+                   int loc_known[], int my_rank, idx_t loc_n)
+{
+    idx_t loc_v;
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        loc_known[loc_v] = 0;
+
+    /* known is all bits set so it can be used as a blend mask */
+    if (src / loc_n == my_rank)
+        loc_known[src % loc_n] = -1;
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        loc_dist[loc_v] = loc_mat[(size_t)src * loc_n + loc_v];
+        loc_pred[loc_v] = src;
+    }
+}
+
+void Dijkstra(dist_t loc_mat[], idx_t src, dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n,
+              idx_t n, MPI_Comm comm)
+{
+
+    idx_t i, loc_u, glbl_u;
+    dist_t dist_glbl_u;
+    int my_rank;
+    int *loc_known;
+    Dist_loc my_min, glbl_min;
+
+    MPI_Comm_rank(comm, &my_rank);
+    loc_known = malloc(loc_n * sizeof(int));
+
+    Dijkstra_Init(loc_mat, src, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    loc_u = Find_min_dist(loc_dist, loc_known, loc_n);
+
+    for (i = 0; i < n - 1; i++)
+    {
+        if (loc_u != -1)
+        {
+            my_min.dist = loc_dist[loc_u];
+            my_min.v = loc_u + my_rank * loc_n;
+        }
+        else
+        {
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
+        }
+
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
+        loc_u = glbl_min.v % loc_n;
+
+        glbl_u = glbl_min.v;
+        dist_glbl_u = glbl_min.dist;
+
+        if (glbl_min.v == -1)
+            break;
+
+        /* only the owner of glbl_u has it in its local block */
+        if (glbl_u / loc_n == my_rank)
+            loc_known[loc_u] = -1;
+
+        /* also gives the local candidate for the next iteration */
+        loc_u = Relax_find_min_par(&loc_mat[(size_t)glbl_u * loc_n], dist_glbl_u, glbl_u,
+                                   loc_dist, loc_pred, loc_known, loc_n);
+    }
+    free(loc_known);
+}
+
+/* -t: the path from every source to opts->target, see P2P in the
+ * header.  With -bidir the processes become two halves that each hold
+ * the whole graph, the second one transposed.  -landmarks without -t
+ * only builds the ALT index */
+void P2p_queries(dist_t **loc_mat_p, idx_t n, idx_t loc_n, Options *opts, double load_time,
+                 int my_rank, int p)
+{
+    dist_t *h = NULL;
+    idx_t *fwd_pred = NULL, *rev_pred = NULL, *loc_pred, src, tgt = opts->target, q;
+    dist_t *loc_dist;
+    MPI_Comm comm = MPI_COMM_WORLD, pair_comm = MPI_COMM_NULL;
+    int my_group = 0, grp_rank, bidir = opts->use_bidir;
+    long long settled[2], my_settled[2], settled_sum = 0;
+    double start, time, max_time, total_time = 0, alt_time = 0;
+    Dist_loc best;
+    Alt_index alt;
+    FILE *output_file = NULL;
+
+    if (tgt >= n)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "Vertex " IDX_FMT " is not in 0.." IDX_FMT "\n", tgt, n - 1);
+        return;
+    }
+    if (bidir && p % 2 != 0)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "-bidir needs an even number of processes, ignoring it\n");
+        bidir = 0;
+    }
+    if (bidir && opts->potential_file != NULL && my_rank == 0)
+        fprintf(stderr, "-potential is not used with -bidir\n");
+    alt.k = 0;
+    alt.landmarks = NULL;
+    alt.loc_dist = NULL;
+    if (opts->n_landmarks > 0 || (opts->alt_file != NULL && tgt >= 0 && !bidir))
+    {
+        start = MPI_Wtime();
+        if (opts->n_landmarks > 0)
+        {
+            Build_alt(*loc_mat_p, n, loc_n, opts->n_landmarks, &alt, comm);
+            Write_alt(opts->alt_file ? opts->alt_file : ALT_FILE, &alt, n, loc_n, comm);
+        }
+        else if (Read_alt(opts->alt_file, &alt, n, loc_n, comm) != 0 && my_rank == 0)
+            fprintf(stderr, "%s is not an ALT index of this graph\n", opts->alt_file);
+        alt_time = MPI_Wtime() - start;
+    }
+    if (tgt < 0)
+    {
+        if (my_rank == 0 && (output_file = fopen("dijkstra_output.txt", "w")) != NULL)
+        {
+            fprintf(output_file, "alt: %d landmarks in %s\n", alt.k,
+                    opts->alt_file ? opts->alt_file : ALT_FILE);
+            fprintf(output_file, "t_alt: %f s\n", alt_time);
+            fprintf(output_file, "t_load: %f s\n", load_time);
+            fclose(output_file);
+        }
+        Free_alt(&alt);
+        return;
+    }
+    if (bidir && alt.k > 0 && my_rank == 0)
+        fprintf(stderr, "the ALT index is not used with -bidir\n");
+
+    if (bidir)
+    {
+        /* world ranks 2k and 2k + 1 hold the same vertices in the halves */
+        my_group = my_rank % 2;
+        MPI_Comm_split(MPI_COMM_WORLD, my_group, my_rank, &comm);
+        MPI_Comm_split(MPI_COMM_WORLD, my_rank / 2, my_rank, &pair_comm);
+        Merge_blk_cols(loc_mat_p, n, loc_n, pair_comm);
+        loc_n *= 2;
+        if (my_group == 1)
+            Transpose_blk_cols(*loc_mat_p, n, loc_n, comm);
+    }
+    else if (alt.k > 0)
+    {
+        if (opts->potential_file != NULL && my_rank == 0)
+            fprintf(stderr, "-potential is not used with an ALT index\n");
+        h = Alt_potential(&alt, tgt, n, loc_n, comm);
+    }
+    else if (opts->potential_file != NULL)
+        h = Read_potential(opts->potential_file, n, my_rank, comm);
+    Free_alt(&alt);
+    MPI_Comm_rank(comm, &grp_rank);
+
+    loc_dist = malloc(loc_n * sizeof(dist_t));
+    loc_pred = malloc(loc_n * sizeof(idx_t));
+    if (grp_rank == 0)
+        fwd_pred = malloc(n * sizeof(idx_t));
+    if (my_rank == 0)
+    {
+        rev_pred = malloc(n * sizeof(idx_t));
+        output_file = fopen("dijkstra_output.txt", "w");
+        if (output_file == NULL)
+            fprintf(stderr, "Error opening output file\n");
+    }
+
+    for (q = 0; q < opts->n_sources; q++)
+    {
+        src = opts->sources[q];
+        MPI_Barrier(MPI_COMM_WORLD);
+        start = MPI_Wtime();
+        my_settled[0] = my_settled[1] = 0;
+        if (bidir)
+            Dijkstra_bidir(*loc_mat_p, (my_group == 0) ? src : tgt, loc_dist, loc_pred, loc_n,
+                           comm, pair_comm, &best, &my_settled[my_group]);
+        else
+        {
+            Dijkstra_p2p(*loc_mat_p, h, src, tgt, loc_dist, loc_pred, loc_n, n, comm,
+                         &my_settled[0]);
+            /* the owner of tgt has its distance */
+            best.dist = (tgt / loc_n == my_rank) ? loc_dist[tgt % loc_n] : DIST_INF;
+            best.v = tgt;
+            MPI_Allreduce(MPI_IN_PLACE, &best.dist, 1, MPI_DIST_T, MPI_MIN, comm);
+        }
+        time = MPI_Wtime() - start;
+
+        MPI_Gather(loc_pred, loc_n, MPI_IDX_T, fwd_pred, loc_n, MPI_IDX_T, 0, comm);
+        if (bidir && my_rank == 1)
+            MPI_Send(fwd_pred, n, MPI_IDX_T, 0, 0, MPI_COMM_WORLD);
+        else if (bidir && my_rank == 0)
+            MPI_Recv(rev_pred, n, MPI_IDX_T, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (grp_rank != 0)
+            my_settled[0] = my_settled[1] = 0;
+        MPI_Reduce(my_settled, settled, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (my_rank == 0)
+        {
+            total_time += max_time;
+            settled_sum += settled[0] + settled[1];
+            if (output_file != NULL)
+                Print_p2p(fwd_pred, bidir ? rev_pred : NULL, src, tgt, &best, settled, max_time,
+                          n, output_file);
+        }
+    }
+
+    if (my_rank == 0 && output_file != NULL)
+    {
+        fprintf(output_file, "t_p2p: %f s\n", total_time);
+        fprintf(output_file, "t_load: %f s\n", load_time);
+        fprintf(output_file, "queries: " IDX_FMT ", settled per query: %.1f of " IDX_FMT "\n",
+                opts->n_sources, (double)settled_sum / opts->n_sources, n);
+        fprintf(output_file, "p2p: %s\n",
+                bidir ? "bidirectional" : (h != NULL) ? "A*" : "early stop");
+        if (alt_time > 0 && !bidir)
+            fprintf(output_file, "t_alt: %f s\n", alt_time);
+        fclose(output_file);
+    }
+    if (bidir)
+    {
+        MPI_Comm_free(&comm);
+        MPI_Comm_free(&pair_comm);
+    }
+    free(h);
+    free(loc_dist);
+    free(loc_pred);
+    free(fwd_pred);
+    free(rev_pred);
+}
+
+/* The update batches of -updates on every process, read by process 0.
+ * Batch b is edges batch_off[b] .. batch_off[b + 1] - 1 */
+Edge *Read_updates(char *path, idx_t n, idx_t *n_batches_p, idx_t **batch_off_p, int my_rank,
+                   MPI_Comm comm)
+{
+    FILE *fp;
+    char line[QUERY_LINE];
+    Edge *upd = NULL;
+    idx_t m = 0, max_m = 0, n_batches = 0, max_batches = 16, *batch_off, counts[2];
+    long long u, v;
+    dist_t w;
+
+    batch_off = malloc((max_batches + 1) * sizeof(idx_t));
+    batch_off[0] = 0;
+    if (my_rank == 0)
+    {
+        fp = fopen(path, "r");
+        if (fp == NULL)
+            fprintf(stderr, "Can't open update file %s\n", path);
+        while (fp != NULL && fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (sscanf(line, "%lld %lld " DIST_SCAN_FMT, &u, &v, &w) != 3)
+            {
+                /* a blank line ends the batch */
+                if (strspn(line, " \t\r\n") == strlen(line) && m > batch_off[n_batches])
+                {
+                    if (n_batches + 1 == max_batches)
+                        batch_off = realloc(batch_off, ((max_batches *= 2) + 1) * sizeof(idx_t));
+                    batch_off[++n_batches] = m;
+                }
+                continue;
+            }
+            if (u < 0 || u >= n || v < 0 || v >= n || u == v)
+            {
+                fprintf(stderr, "Skipping update %lld %lld\n", u, v);
+                continue;
+            }
+            if (m == max_m)
+                upd = realloc(upd, (max_m = max_m ? 2 * max_m : 64) * sizeof(Edge));
+            upd[m].u = u;
+            upd[m].v = v;
+            upd[m].w = (w >= INFINITY) ? DIST_INF : w;
+            m++;
+        }
+        if (m > batch_off[n_batches])
+        {
+            if (n_batches + 1 == max_batches)
+                batch_off = realloc(batch_off, ((max_batches *= 2) + 1) * sizeof(idx_t));
+            batch_off[++n_batches] = m;
+        }
+        if (fp != NULL)
+            fclose(fp);
+    }
+
+    counts[0] = m;
+    counts[1] = n_batches;
+    MPI_Bcast(counts, 2, MPI_IDX_T, 0, comm);
+    m = counts[0];
+    n_batches = counts[1];
+    if (my_rank != 0)
+    {
+        upd = malloc((m + 1) * sizeof(Edge));
+        batch_off = realloc(batch_off, (n_batches + 1) * sizeof(idx_t));
+    }
+    MPI_Bcast(batch_off, n_batches + 1, MPI_IDX_T, 0, comm);
+    MPI_Bcast(upd, m * sizeof(Edge), MPI_BYTE, 0, comm);
+    *n_batches_p = n_batches;
+    *batch_off_p = batch_off;
+    return upd;
+}
+
+/* -updates, see Updates in the header.  Every source keeps its tree over
+ * all batches */
+void Dynamic_updates(dist_t loc_mat[], idx_t n, idx_t loc_n, Options *opts, double load_time,
+                     int my_rank)
+{
+    dist_t *loc_dist, *global_dist = NULL;
+    idx_t *loc_pred, *global_pred = NULL, *batch_off, n_batches, b, q, e, m;
+    dist_t *old_w;
+    Edge *upd;
+    long long repaired, sum_repaired;
+    double start, time, max_time, init_time = 0, repair_time = 0;
+    FILE *output_file = NULL;
+    Path_file paths;
+
+    upd = Read_updates(opts->update_file, n, &n_batches, &batch_off, my_rank, MPI_COMM_WORLD);
+    loc_dist = malloc((size_t)opts->n_sources * loc_n * sizeof(dist_t));
+    loc_pred = malloc((size_t)opts->n_sources * loc_n * sizeof(idx_t));
+    if (my_rank == 0)
+    {
+        global_dist = malloc(n * sizeof(dist_t));
+        global_pred = malloc(n * sizeof(idx_t));
+        output_file = fopen("dijkstra_output.txt", "w");
+        if (output_file == NULL)
+            fprintf(stderr, "Error opening output file\n");
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for (q = 0; q < opts->n_sources; q++)
+        Dijkstra(loc_mat, opts->sources[q], &loc_dist[(size_t)q * loc_n],
+                 &loc_pred[(size_t)q * loc_n], loc_n, n, MPI_COMM_WORLD);
+    time = MPI_Wtime() - start;
+    MPI_Reduce(&time, &init_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    for (b = 0; b < n_batches; b++)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        start = MPI_Wtime();
+        sum_repaired = 0;
+        m = batch_off[b + 1] - batch_off[b];
+
+        /* the owner of column v applies u->v, keeping the weight before */
+        old_w = malloc((m + 1) * sizeof(dist_t));
+        for (e = 0; e < m; e++)
+        {
+            Edge *ed = &upd[batch_off[b] + e];
+
+            if (ed->v / loc_n == my_rank)
+            {
+                old_w[e] = loc_mat[(size_t)ed->u * loc_n + ed->v % loc_n];
+                loc_mat[(size_t)ed->u * loc_n + ed->v % loc_n] = ed->w;
+            }
+        }
+        for (q = 0; q < opts->n_sources; q++)
+        {
+            repaired = Repair_sssp(loc_mat, &upd[batch_off[b]], old_w, m, opts->sources[q],
+                                   &loc_dist[(size_t)q * loc_n], &loc_pred[(size_t)q * loc_n],
+                                   loc_n, n, MPI_COMM_WORLD);
+            sum_repaired += repaired;
+        }
+        free(old_w);
+        time = MPI_Wtime() - start;
+        MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (my_rank == 0)
+        {
+            repair_time += max_time;
+            if (output_file != NULL)
+                fprintf(output_file,
+                        "batch " IDX_FMT ": " IDX_FMT " updates, %.1f of " IDX_FMT
+                        " vertices repaired per source, t: %f s\n",
+                        b, batch_off[b + 1] - batch_off[b],
+                        (double)sum_repaired / opts->n_sources, n, max_time);
+        }
+    }
+
+    if (opts->path_file != NULL &&
+        !Open_path_file(&paths, opts->path_file, opts->path_binary, n, MPI_COMM_WORLD))
+        opts->path_file = NULL;
+    for (q = 0; q < opts->n_sources; q++)
+    {
+        MPI_Gather(&loc_dist[(size_t)q * loc_n], loc_n, MPI_DIST_T, global_dist, loc_n,
+                   MPI_DIST_T, 0, MPI_COMM_WORLD);
+        MPI_Gather(&loc_pred[(size_t)q * loc_n], loc_n, MPI_IDX_T, global_pred, loc_n,
+                   MPI_IDX_T, 0, MPI_COMM_WORLD);
+        if (output_file != NULL)
+        {
+            Print_dists(global_dist, opts->sources[q], n, output_file);
+            if (opts->path_file == NULL)
+                Print_paths(global_pred, opts->sources[q], n, output_file);
+        }
+        if (opts->path_file != NULL)
+            Write_paths_par(global_pred, opts->sources[q], n, &paths, MPI_COMM_WORLD);
+    }
+    if (opts->path_file != NULL)
+        Close_path_file(&paths);
+    if (output_file != NULL)
+    {
+        fprintf(output_file, "t_initial: %f s\n", init_time);
+        fprintf(output_file, "t_repair: %f s for " IDX_FMT " batches\n", repair_time, n_batches);
+        fprintf(output_file, "t_load: %f s\n", load_time);
+        fclose(output_file);
+    }
+    free(upd);
+    free(batch_off);
+    free(loc_dist);
+    free(loc_pred);
+    free(global_dist);
+    free(global_pred);
+}
+
+/* Brings the tree from src up to date after the edges in upd got their
+ * new weights in loc_mat, see Updates in the header.  old_w has the
+ * weights before, on the owners of the columns.  Returns the number of
+ * vertices settled again, the same on every process */
+long long Repair_sssp(dist_t loc_mat[], Edge upd[], dist_t old_w[], idx_t m, idx_t src,
+                      dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n, idx_t n, MPI_Comm comm)
+{
+    dist_t *dist, cand;
+    idx_t *pred, *child_off, *child, *stack, e, u, v, loc_v, base, top;
+    int my_rank, *kind, *in_q;
+    char *affected;
+    long long settled = 0;
+    Dist_loc my_min, glbl_min;
+
+    MPI_Comm_rank(comm, &my_rank);
+    base = (idx_t)my_rank * loc_n;
+    kind = calloc(m + 1, sizeof(int));
+    in_q = calloc(loc_n, sizeof(int));
+
+    /* 1 = a tree edge got heavier, 2 = an edge got lighter */
+    for (e = 0; e < m; e++)
+    {
+        u = upd[e].u;
+        v = upd[e].v;
+        if (v / loc_n != my_rank)
+            continue;
+        if (upd[e].w > old_w[e] && loc_pred[v - base] == u)
+            kind[e] = 1;
+        else if (upd[e].w < old_w[e])
+            kind[e] = 2;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, kind, m, MPI_INT, MPI_MAX, comm);
+
+    dist = malloc(n * sizeof(dist_t));
+    pred = malloc(n * sizeof(idx_t));
+    MPI_Allgather(loc_dist, loc_n, MPI_DIST_T, dist, loc_n, MPI_DIST_T, comm);
+    MPI_Allgather(loc_pred, loc_n, MPI_IDX_T, pred, loc_n, MPI_IDX_T, comm);
+
+    /* children of every vertex in the tree, then the subtrees below the
+     * heavier tree edges */
+    affected = calloc(n, 1);
+    child_off = calloc(n + 1, sizeof(idx_t));
+    child = malloc(n * sizeof(idx_t));
+    stack = malloc(n * sizeof(idx_t));
+    for (v = 0; v < n; v++)
+        if (v != src && dist[v] != DIST_INF)
+            child_off[pred[v] + 1]++;
+    for (v = 0; v < n; v++)
+        child_off[v + 1] += child_off[v];
+    for (v = 0; v < n; v++)
+        if (v != src && dist[v] != DIST_INF)
+            child[child_off[pred[v]]++] = v;
+    for (v = n; v > 0; v--)
+        child_off[v] = child_off[v - 1];
+    child_off[0] = 0;
+    top = 0;
+    for (e = 0; e < m; e++)
+        if (kind[e] == 1 && !affected[upd[e].v] && upd[e].v != src)
+        {
+            affected[upd[e].v] = 1;
+            stack[top++] = upd[e].v;
+        }
+    while (top > 0)
+    {
+        u = stack[--top];
+        for (e = child_off[u]; e < child_off[u + 1]; e++)
+            if (!affected[child[e]])
+            {
+                affected[child[e]] = 1;
+                stack[top++] = child[e];
+            }
+    }
+
+    /* affected vertices start over from their unaffected in-neighbours */
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        if (!affected[base + loc_v])
+            continue;
+        loc_dist[loc_v] = DIST_INF;
+        loc_pred[loc_v] = src;
+        for (u = 0; u < n; u++)
+            if (!affected[u] && dist[u] != DIST_INF)
+            {
+                cand = Sat_add(dist[u], loc_mat[(size_t)u * loc_n + loc_v]);
+                if (cand < loc_dist[loc_v])
+                {
+                    loc_dist[loc_v] = cand;
+                    loc_pred[loc_v] = u;
+                }
+            }
+        in_q[loc_v] = (loc_dist[loc_v] != DIST_INF);
+    }
+    /* and the heads of the lighter edges may get shorter */
+    for (e = 0; e < m; e++)
+    {
+        u = upd[e].u;
+        v = upd[e].v;
+        if (kind[e] != 2 || v / loc_n != my_rank || affected[u] || dist[u] == DIST_INF)
+            continue;
+        /* the last update of u->v in the batch is the one that holds */
+        cand = Sat_add(dist[u], loc_mat[(size_t)u * loc_n + v - base]);
+        if (cand < loc_dist[v - base])
+        {
+            loc_dist[v - base] = cand;
+            loc_pred[v - base] = u;
+            in_q[v - base] = 1;
+        }
+    }
+
+    /* Dijkstra over the queued vertices only */
+    while (1)
+    {
+        my_min.dist = DIST_INF;
+        my_min.v = -1;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (in_q[loc_v] && (my_min.v == -1 || loc_dist[loc_v] < my_min.dist))
+            {
+                my_min.dist = loc_dist[loc_v];
+                my_min.v = base + loc_v;
+            }
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
+        if (glbl_min.v == -1)
+            break;
+        u = glbl_min.v;
+        if (u / loc_n == my_rank)
+            in_q[u - base] = 0;
+        settled++;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        {
+            cand = Sat_add(glbl_min.dist, loc_mat[(size_t)u * loc_n + loc_v]);
+            if (cand < loc_dist[loc_v])
+            {
+                loc_dist[loc_v] = cand;
+                loc_pred[loc_v] = u;
+                in_q[loc_v] = 1;
+            }
+        }
+    }
+
+    free(kind);
+    free(in_q);
+    free(dist);
+    free(pred);
+    free(affected);
+    free(child_off);
+    free(child);
+    free(stack);
+    return settled;
+}
+
+/* A Unix domain socket listening at path, -1 on failure */
+static int Open_server_socket(char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Process 0: the next valid query in cmd = {kind, s, t, k}.  Bad lines
+ * are answered here, the end of stdin is quit and the end of a socket
+ * client means waiting for the next one */
+static void Next_query(FILE **in_p, FILE **out_p, int listen_fd, idx_t n, idx_t cmd[])
+{
+    char line[QUERY_LINE], word[16];
+    long long a, b;
+    int got, client;
+
+    while (1)
+    {
+        if (*in_p == NULL || fgets(line, sizeof(line), *in_p) == NULL)
+        {
+            if (listen_fd < 0)
+            {
+                cmd[0] = QUERY_QUIT;
+                return;
+            }
+            if (*in_p != NULL)
+            {
+                fclose(*in_p);
+                fclose(*out_p);
+            }
+            client = accept(listen_fd, NULL, NULL);
+            if (client < 0)
+            {
+                *in_p = *out_p = NULL;
+                cmd[0] = QUERY_QUIT;
+                return;
+            }
+            *in_p = fdopen(client, "r");
+            *out_p = fdopen(dup(client), "w");
+            continue;
+        }
+
+        got = sscanf(line, "%15s %lld %lld", word, &a, &b);
+        if (got <= 0)
+            continue;
+        cmd[1] = a;
+        cmd[2] = -1;
+        cmd[3] = 0;
+        if (strcmp(word, "quit") == 0)
+        {
+            cmd[0] = QUERY_QUIT;
+            return;
+        }
+        if (got >= 2 && a >= 0 && a < n)
+        {
+            if (strcmp(word, "sssp") == 0)
+            {
+                cmd[0] = QUERY_SSSP;
+                return;
+            }
+            if (strcmp(word, "path") == 0 && got == 3 && b >= 0 && b < n)
+            {
+                cmd[0] = QUERY_PATH;
+                cmd[2] = b;
+                return;
+            }
+            if (strcmp(word, "knn") == 0 && got == 3 && b > 0)
+            {
+                cmd[0] = QUERY_KNN;
+                cmd[3] = b;
+                return;
+            }
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        fprintf(*out_p, "error: bad query '%s'\n", line);
+        fflush(*out_p);
+    }
+}
+
+/* -server, see Server in the header */
+void Serve_queries(dist_t loc_mat[], Loc_csr *csr, idx_t n, idx_t loc_n, Options *opts,
+                   double load_time, int my_rank, int p)
+{
+    idx_t cmd[4], *loc_pred, *global_pred = NULL, count = 0, n_near, i;
+    dist_t *loc_dist, *global_dist = NULL;
+    FILE *in = NULL, *out = NULL, *output_file;
+    int listen_fd = -1, hit, *loc_known;
+    Sp_cache cache;
+    Dist_loc *near;
+    long long settled;
+    double start, latency, sum_latency = 0, max_latency = 0;
+
+    loc_dist = malloc(loc_n * sizeof(dist_t));
+    loc_pred = malloc(loc_n * sizeof(idx_t));
+    loc_known = malloc(loc_n * sizeof(int));
+    Init_sp_cache(&cache, opts->cache_mb, loc_n, MPI_COMM_WORLD);
+    if (my_rank == 0)
+    {
+        /* loc_n * p >= n when the edge list was padded */
+        global_dist = malloc((size_t)loc_n * p * sizeof(dist_t));
+        global_pred = malloc((size_t)loc_n * p * sizeof(idx_t));
+        if (opts->socket_path != NULL)
+        {
+            listen_fd = Open_server_socket(opts->socket_path);
+            if (listen_fd < 0)
+                fprintf(stderr, "Can't listen on %s\n", opts->socket_path);
+            else
+                fprintf(stderr, "serving " IDX_FMT " vertices on %s\n", n, opts->socket_path);
+        }
+        else
+        {
+            in = stdin;
+            out = stdout;
+        }
+    }
+
+    while (1)
+    {
+        if (my_rank == 0)
+        {
+            if (opts->socket_path != NULL && listen_fd < 0)
+                cmd[0] = QUERY_QUIT;
+            else
+                Next_query(&in, &out, listen_fd, n, cmd);
+        }
+        MPI_Bcast(cmd, 4, MPI_IDX_T, 0, MPI_COMM_WORLD);
+        if (cmd[0] == QUERY_QUIT)
+            break;
+
+        start = MPI_Wtime();
+        /* path and knn queries stop early, so only whole trees go to the
+         * cache */
+        hit = Sp_cache_get(&cache, cmd[1], loc_dist, loc_pred);
+        if (!hit && cmd[0] == QUERY_KNN && loc_mat != NULL)
+        {
+            Dijkstra_bounded(loc_mat, cmd[1], DIST_INF, cmd[3], loc_dist, loc_pred, loc_known,
+                             loc_n, n, MPI_COMM_WORLD, &settled);
+            near = Gather_settled(loc_dist, loc_pred, loc_known, loc_n, global_pred, &n_near,
+                                  my_rank, MPI_COMM_WORLD);
+            latency = MPI_Wtime() - start;
+            if (my_rank == 0)
+            {
+                for (i = 0; i < (idx_t)loc_n * p; i++)
+                    global_dist[i] = DIST_INF;
+                for (i = 0; i < n_near; i++)
+                    global_dist[near[i].v] = near[i].dist;
+                count++;
+                sum_latency += latency;
+                if (latency > max_latency)
+                    max_latency = latency;
+                Answer_query(cmd, global_dist, global_pred, n, latency, out);
+            }
+            free(near);
+            continue;
+        }
+        if (hit)
+            ;
+        else if (cmd[0] == QUERY_PATH && loc_mat != NULL)
+            Dijkstra_p2p(loc_mat, NULL, cmd[1], cmd[2], loc_dist, loc_pred, loc_n, n,
+                         MPI_COMM_WORLD, &settled);
+        else if (loc_mat != NULL)
+            Dijkstra(loc_mat, cmd[1], loc_dist, loc_pred, loc_n, n, MPI_COMM_WORLD);
+        else
+            Dijkstra_csr(csr, cmd[1], loc_dist, loc_pred, loc_n, n, MPI_COMM_WORLD);
+        if (!hit && !(cmd[0] == QUERY_PATH && loc_mat != NULL))
+            Sp_cache_put(&cache, cmd[1], loc_dist, loc_pred);
+        MPI_Gather(loc_dist, loc_n, MPI_DIST_T, global_dist, loc_n, MPI_DIST_T, 0,
+                   MPI_COMM_WORLD);
+        MPI_Gather(loc_pred, loc_n, MPI_IDX_T, global_pred, loc_n, MPI_IDX_T, 0,
+                   MPI_COMM_WORLD);
+        latency = MPI_Wtime() - start;
+
+        if (my_rank == 0)
+        {
+            count++;
+            sum_latency += latency;
+            if (latency > max_latency)
+                max_latency = latency;
+            Answer_query(cmd, global_dist, global_pred, n, latency, out);
+        }
+    }
+
+    if (my_rank == 0)
+    {
+        if (out != NULL)
+        {
+            fprintf(out, "bye\n");
+            fflush(out);
+        }
+        if (listen_fd >= 0)
+        {
+            if (in != NULL)
+            {
+                fclose(in);
+                fclose(out);
+            }
+            close(listen_fd);
+            unlink(opts->socket_path);
+        }
+        output_file = fopen("dijkstra_output.txt", "w");
+        if (output_file != NULL)
+        {
+            fprintf(output_file, "server: " IDX_FMT " queries, latency mean %f s, max %f s\n",
+                    count, count ? sum_latency / count : 0.0, max_latency);
+            fprintf(output_file, "t_load: %f s\n", load_time);
+            if (cache.cap > 0)
+                fprintf(output_file, "cache: %lld hits, %lld misses, %d trees\n", cache.hits,
+                        cache.misses, cache.cap);
+            fclose(output_file);
+        }
+    }
+    Free_sp_cache(&cache);
+    free(loc_dist);
+    free(loc_pred);
+    free(loc_known);
+    free(global_dist);
+    free(global_pred);
+}
+
+/* by distance, then vertex */
+static int Cmp_dist_loc(const void *a, const void *b)
+{
+    const Dist_loc *x = a, *y = b;
+
+    if (x->dist != y->dist)
+        return (x->dist < y->dist) ? -1 : 1;
+    return (x->v > y->v) - (x->v < y->v);
+}
+
+static void Print_dist(FILE *out, dist_t d)
+{
+    if (d == DIST_INF)
+        fprintf(out, "inf");
+    else
+        fprintf(out, DIST_FMT, d);
+}
+
+/* One line per answer: the query, its latency and the result */
+void Answer_query(idx_t cmd[], dist_t global_dist[], idx_t global_pred[], idx_t n,
+                  double latency, FILE *out)
+{
+    idx_t v, w, count = 0, *path;
+    Dist_loc *near;
+
+    if (cmd[0] == QUERY_SSSP)
+    {
+        fprintf(out, "sssp " IDX_FMT " (%.3f ms):", cmd[1], latency * 1e3);
+        for (v = 0; v < n; v++)
+        {
+            fprintf(out, " ");
+            Print_dist(out, global_dist[v]);
+        }
+    }
+    else if (cmd[0] == QUERY_PATH)
+    {
+        fprintf(out, "path " IDX_FMT " " IDX_FMT " (%.3f ms): ", cmd[1], cmd[2], latency * 1e3);
+        Print_dist(out, global_dist[cmd[2]]);
+        if (cmd[1] == cmd[2])
+            fprintf(out, ": " IDX_FMT, cmd[1]);
+        else if (global_dist[cmd[2]] != DIST_INF)
+        {
+            path = malloc(n * sizeof(idx_t));
+            for (w = cmd[2]; w != cmd[1]; w = global_pred[w])
+                path[count++] = w;
+            fprintf(out, ": " IDX_FMT, cmd[1]);
+            while (count > 0)
+                fprintf(out, " " IDX_FMT, path[--count]);
+            free(path);
+        }
+    }
+    else
+    {
+        near = malloc(n * sizeof(Dist_loc));
+        for (v = 0; v < n; v++)
+            if (v != cmd[1] && global_dist[v] != DIST_INF)
+            {
+                near[count].dist = global_dist[v];
+                near[count].v = v;
+                count++;
+            }
+        qsort(near, count, sizeof(Dist_loc), Cmp_dist_loc);
+        fprintf(out, "knn " IDX_FMT " " IDX_FMT " (%.3f ms):", cmd[1], cmd[3], latency * 1e3);
+        for (v = 0; v < count && v < cmd[3]; v++)
+        {
+            fprintf(out, " " IDX_FMT ":", near[v].v);
+            Print_dist(out, near[v].dist);
+        }
+        free(near);
+    }
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+/* Dense Dijkstra from src that stops before settling a vertex farther
+ * than radius or once k vertices besides src are settled (k = 0: no
+ * limit).  loc_known is -1 for the settled local vertices and
+ * *settled_p counts them all, src included */
+void Dijkstra_bounded(dist_t loc_mat[], idx_t src, dist_t radius, idx_t k, dist_t loc_dist[],
+                      idx_t loc_pred[], int loc_known[], idx_t loc_n, idx_t n, MPI_Comm comm,
+                      long long *settled_p)
+{
+    idx_t i, loc_u, glbl_u;
+    int my_rank;
+    Dist_loc my_min, glbl_min;
+
+    MPI_Comm_rank(comm, &my_rank);
+    Dijkstra_Init(loc_mat, src, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    *settled_p = 1;
+    loc_u = Find_min_dist(loc_dist, loc_known, loc_n);
+
+    for (i = 0; i < n - 1 && (k == 0 || *settled_p <= k); i++)
+    {
+        if (loc_u != -1)
+        {
+            my_min.dist = loc_dist[loc_u];
+            my_min.v = loc_u + my_rank * loc_n;
+        }
+        else
+        {
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
+        }
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
+        if (glbl_min.v == -1 || glbl_min.dist > radius)
+            break;
+
+        glbl_u = glbl_min.v;
+        if (glbl_u / loc_n == my_rank)
+            loc_known[glbl_u % loc_n] = -1;
+        (*settled_p)++;
+        loc_u = Relax_find_min_par(&loc_mat[(size_t)glbl_u * loc_n], glbl_min.dist, glbl_u,
+                                   loc_dist, loc_pred, loc_known, loc_n);
+    }
+}
+
+/* The settled vertices of all processes on process 0, nearest first,
+ * with their predecessors in global_pred.  Only they are sent */
+Dist_loc *Gather_settled(dist_t loc_dist[], idx_t loc_pred[], int loc_known[], idx_t loc_n,
+                         idx_t global_pred[], idx_t *count_p, int my_rank, MPI_Comm comm)
+{
+    Dist_loc *mine, *near = NULL;
+    idx_t *my_pred, *near_pred = NULL, loc_v, i;
+    int p, q, my_count = 0, *counts = NULL, *displs = NULL;
+
+    MPI_Comm_size(comm, &p);
+    mine = malloc((loc_n + 1) * sizeof(Dist_loc));
+    my_pred = malloc((loc_n + 1) * sizeof(idx_t));
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        if (loc_known[loc_v])
+        {
+            mine[my_count].dist = loc_dist[loc_v];
+            mine[my_count].v = loc_v + my_rank * loc_n;
+            my_pred[my_count] = loc_pred[loc_v];
+            my_count++;
+        }
+
+    if (my_rank == 0)
+    {
+        counts = malloc(p * sizeof(int));
+        displs = malloc(p * sizeof(int));
+    }
+    MPI_Gather(&my_count, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    *count_p = 0;
+    if (my_rank == 0)
+    {
+        for (q = 0; q < p; q++)
+        {
+            displs[q] = *count_p;
+            *count_p += counts[q];
+        }
+        near = malloc((*count_p + 1) * sizeof(Dist_loc));
+        near_pred = malloc((*count_p + 1) * sizeof(idx_t));
+    }
+    MPI_Gatherv(mine, my_count, dist_loc_mpi_t, near, counts, displs, dist_loc_mpi_t, 0, comm);
+    MPI_Gatherv(my_pred, my_count, MPI_IDX_T, near_pred, counts, displs, MPI_IDX_T, 0, comm);
+
+    if (my_rank == 0)
+    {
+        for (i = 0; i < *count_p; i++)
+            global_pred[near[i].v] = near_pred[i];
+        qsort(near, *count_p, sizeof(Dist_loc), Cmp_dist_loc);
+    }
+    free(mine);
+    free(my_pred);
+    free(counts);
+    free(displs);
+    free(near_pred);
+    return near;
+}
+
+/* -radius / -knn, see Bounded in the header */
+void Bounded_queries(dist_t loc_mat[], idx_t n, idx_t loc_n, Options *opts, double load_time,
+                     int my_rank)
+{
+    dist_t *loc_dist, radius = DIST_INF;
+    idx_t *loc_pred, *global_pred = NULL, q, count, sum_count = 0;
+    int *loc_known;
+    long long settled;
+    double start, time, max_time, total_time = 0;
+    Dist_loc *near;
+    FILE *output_file = NULL;
+
+    if (opts->radius >= 0 && opts->radius < (double)DIST_INF)
+        radius = (dist_t)opts->radius;
+    loc_dist = malloc(loc_n * sizeof(dist_t));
+    loc_pred = malloc(loc_n * sizeof(idx_t));
+    loc_known = malloc(loc_n * sizeof(int));
+    if (my_rank == 0)
+    {
+        global_pred = malloc(n * sizeof(idx_t));
+        output_file = fopen("dijkstra_output.txt", "w");
+        if (output_file == NULL)
+            fprintf(stderr, "Error opening output file\n");
+    }
+
+    for (q = 0; q < opts->n_sources; q++)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        start = MPI_Wtime();
+        Dijkstra_bounded(loc_mat, opts->sources[q], radius, opts->knn, loc_dist, loc_pred,
+                         loc_known, loc_n, n, MPI_COMM_WORLD, &settled);
+        near = Gather_settled(loc_dist, loc_pred, loc_known, loc_n, global_pred, &count,
+                              my_rank, MPI_COMM_WORLD);
+        time = MPI_Wtime() - start;
+        MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (my_rank == 0)
+        {
+            total_time += max_time;
+            sum_count += count - 1;
+            if (output_file != NULL)
+                Print_bounded(near, count, global_pred, opts->sources[q], n, output_file);
+        }
+        free(near);
+    }
+
+    if (output_file != NULL)
+    {
+        fprintf(output_file, "t_bounded: %f s\n", total_time);
+        fprintf(output_file, "t_load: %f s\n", load_time);
+        fprintf(output_file, "queries: " IDX_FMT ", vertices per query: %.1f of " IDX_FMT "\n",
+                opts->n_sources, (double)sum_count / opts->n_sources, n);
+        fprintf(output_file, "bounded:");
+        if (radius != DIST_INF)
+            fprintf(output_file, " radius " DIST_FMT, radius);
+        if (opts->knn > 0)
+            fprintf(output_file, " knn " IDX_FMT, opts->knn);
+        fprintf(output_file, "\n");
+        fclose(output_file);
+    }
+    free(loc_dist);
+    free(loc_pred);
+    free(loc_known);
+    free(global_pred);
+}
+
+/* The settled vertices of one bounded query, nearest first, and their
+ * paths; global_pred is only set for them */
+void Print_bounded(Dist_loc near[], idx_t count, idx_t global_pred[], idx_t src, idx_t n,
+                   FILE *output_file)
+{
+    idx_t *path = malloc(n * sizeof(idx_t)), i, w, len;
+
+    fprintf(output_file, "    v     dist " IDX_FMT "->v    Path " IDX_FMT "->v\n", src, src);
+    fprintf(output_file, "  ----    ---------    ---------\n");
+    for (i = 0; i < count; i++)
+    {
+        if (near[i].v == src)
+            continue;
+        fprintf(output_file, "    " IDX_FMT "        " DIST_FMT "    ", near[i].v, near[i].dist);
+        len = 0;
+        for (w = near[i].v; w != src; w = global_pred[w])
+            path[len++] = w;
+        fprintf(output_file, IDX_FMT, src);
+        while (len > 0)
+            fprintf(output_file, " " IDX_FMT, path[--len]);
+        fprintf(output_file, "\n");
+    }
+    fprintf(output_file, "\n");
+    free(path);
+}
+
+/* The argmin of dist + h over the unknown local vertices, -1 if none is
+ * reachable */
+static idx_t Find_min_key(dist_t loc_dist[], dist_t loc_h[], int loc_known[], idx_t loc_n)
+{
+    idx_t loc_v, loc_u = -1;
+    dist_t key, shortest_key = DIST_INF;
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        if (!loc_known[loc_v] && loc_dist[loc_v] != DIST_INF)
+        {
+            key = Sat_add(loc_dist[loc_v], loc_h[loc_v]);
+            if (loc_u == -1 || key < shortest_key)
+            {
+                shortest_key = key;
+                loc_u = loc_v;
+            }
+        }
+    return loc_u;
+}
+
+/* Relax_find_min for A*: relaxes the row of glbl_u and returns
+ * Find_min_key of the result in the same pass */
+static idx_t Relax_find_min_key(dist_t row[], dist_t dist_u, idx_t glbl_u, dist_t loc_dist[],
+                                dist_t loc_h[], idx_t loc_pred[], int loc_known[], idx_t loc_n)
+{
+    idx_t loc_v, loc_u = -1;
+    dist_t lim = DIST_INF - dist_u, new_dist, key, shortest_key = DIST_INF;
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        new_dist = (row[loc_v] > lim) ? DIST_INF : dist_u + row[loc_v];
+        if (new_dist < loc_dist[loc_v])
+        {
+            loc_dist[loc_v] = new_dist;
+            loc_pred[loc_v] = glbl_u;
+        }
+        if (!loc_known[loc_v] && loc_dist[loc_v] != DIST_INF)
+        {
+            key = Sat_add(loc_dist[loc_v], loc_h[loc_v]);
+            if (loc_u == -1 || key < shortest_key)
+            {
+                shortest_key = key;
+                loc_u = loc_v;
+            }
+        }
+    }
+    return loc_u;
+}
+
+/* Dense Dijkstra from src that stops once tgt is settled.  With the
+ * potential h (all n vertices, NULL for none) it is A*: the MINLOC is
+ * over dist + h and the distance of the winner is its key - h */
+void Dijkstra_p2p(dist_t loc_mat[], dist_t h[], idx_t src, idx_t tgt, dist_t loc_dist[],
+                  idx_t loc_pred[], idx_t loc_n, idx_t n, MPI_Comm comm,
+                  long long *settled_p)
+{
+    idx_t i, loc_u, glbl_u;
+    dist_t dist_glbl_u;
+    int my_rank;
+    int *loc_known;
+    dist_t *loc_h = NULL;
+    Dist_loc my_min, glbl_min;
+
+    MPI_Comm_rank(comm, &my_rank);
+    loc_known = malloc(loc_n * sizeof(int));
+    if (h != NULL)
+        loc_h = &h[(size_t)my_rank * loc_n];
+
+    Dijkstra_Init(loc_mat, src, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    *settled_p = 1;
+    loc_u = (h != NULL) ? Find_min_key(loc_dist, loc_h, loc_known, loc_n)
+                        : Find_min_dist(loc_dist, loc_known, loc_n);
+
+    for (i = 0; i < n - 1 && src != tgt; i++)
+    {
+        if (loc_u != -1)
+        {
+            my_min.dist = (h != NULL) ? Sat_add(loc_dist[loc_u], loc_h[loc_u]) : loc_dist[loc_u];
+            my_min.v = loc_u + my_rank * loc_n;
+        }
+        else
+        {
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
+        }
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
+        if (glbl_min.v == -1)
+            break;
+
+        glbl_u = glbl_min.v;
+        dist_glbl_u = (h != NULL) ? glbl_min.dist - h[glbl_u] : glbl_min.dist;
+#ifdef DIST_FLOAT
+        /* dist + h - h need not give dist back in float */
+        if (h != NULL)
+            MPI_Bcast(&dist_glbl_u, 1, MPI_DIST_T, glbl_u / loc_n, comm);
+#endif
+        loc_u = glbl_u % loc_n;
+        if (glbl_u / loc_n == my_rank)
+            loc_known[loc_u] = -1;
+        (*settled_p)++;
+        if (glbl_u == tgt)
+            break;
+
+        if (h != NULL)
+            loc_u = Relax_find_min_key(&loc_mat[(size_t)glbl_u * loc_n], dist_glbl_u, glbl_u,
+                                       loc_dist, loc_h, loc_pred, loc_known, loc_n);
+        else
+            loc_u = Relax_find_min_par(&loc_mat[(size_t)glbl_u * loc_n], dist_glbl_u, glbl_u,
+                                       loc_dist, loc_pred, loc_known, loc_n);
+    }
+    free(loc_known);
+}
+
+/* One half of the bidirectional search, from root over the blocks of
+ * this half (the reversed graph in the second half), see P2P in the
+ * header.  *best_p gets mu and the vertex where the two paths meet, on
+ * every process of both halves */
+void Dijkstra_bidir(dist_t loc_mat[], idx_t root, dist_t loc_dist[], idx_t loc_pred[],
+                    idx_t loc_n, MPI_Comm comm, MPI_Comm pair_comm, Dist_loc *best_p,
+                    long long *settled_p)
+{
+    idx_t loc_u, glbl_u;
+    int my_rank, other, *loc_known;
+    Dist_loc my_min, glbl_min, other_min, my_meet, meet;
+
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_rank(pair_comm, &other);
+    other = 1 - other;
+    loc_known = malloc(loc_n * sizeof(int));
+    Dijkstra_Init(loc_mat, root, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    loc_u = Find_min_dist(loc_dist, loc_known, loc_n);
+    best_p->dist = DIST_INF;
+    best_p->v = -1;
+    *settled_p = 1;
+
+    /* the root counts as settled at 0 */
+    glbl_min.dist = 0;
+    glbl_min.v = root;
+    while (1)
+    {
+        /* meet at the vertex the other half settled last */
+        MPI_Sendrecv(&glbl_min, 1, dist_loc_mpi_t, other, 0, &other_min, 1, dist_loc_mpi_t,
+                     other, 0, pair_comm, MPI_STATUS_IGNORE);
+        my_meet.dist = DIST_INF;
+        my_meet.v = -1;
+        if (other_min.v != -1 && other_min.v / loc_n == my_rank &&
+            loc_dist[other_min.v % loc_n] != DIST_INF)
+        {
+            my_meet.dist = Sat_add(loc_dist[other_min.v % loc_n], other_min.dist);
+            my_meet.v = other_min.v;
+        }
+        MPI_Allreduce(&my_meet, &meet, 1, dist_loc_mpi_t, min_loc_op, MPI_COMM_WORLD);
+        if (meet.dist < best_p->dist)
+            *best_p = meet;
+        if (glbl_min.v == -1 || other_min.v == -1 ||
+            Sat_add(glbl_min.dist, other_min.dist) >= best_p->dist)
+            break;
+
+        if (loc_u != -1)
+        {
+            my_min.dist = loc_dist[loc_u];
+            my_min.v = loc_u + my_rank * loc_n;
+        }
+        else
+        {
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
+        }
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
+        if (glbl_min.v == -1)
+            continue;
+        glbl_u = glbl_min.v;
+        if (glbl_u / loc_n == my_rank)
+            loc_known[glbl_u % loc_n] = -1;
+        (*settled_p)++;
+        loc_u = Relax_find_min_par(&loc_mat[(size_t)glbl_u * loc_n], glbl_min.dist, glbl_u,
+                                   loc_dist, loc_pred, loc_known, loc_n);
+    }
+    free(loc_known);
+}
+
+/* Turns the n x loc_n column blocks of the matrix into those of its
+ * transpose: block r of rows of my block goes to process r, which puts
+ * it in its columns transposed */
+void Transpose_blk_cols(dist_t loc_mat[], idx_t n, idx_t loc_n, MPI_Comm comm)
+{
+    dist_t *buf;
+    idx_t i, j;
+    int p, q;
+    MPI_Datatype row_mpi_t;
+
+    MPI_Comm_size(comm, &p);
+    buf = malloc((size_t)n * loc_n * sizeof(dist_t));
+    MPI_Type_contiguous(loc_n, MPI_DIST_T, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    MPI_Alltoall(loc_mat, loc_n, row_mpi_t, buf, loc_n, row_mpi_t, comm);
+    MPI_Type_free(&row_mpi_t);
+
+    /* buf block q row i is matrix row my_rank * loc_n + i, columns of q */
+    for (q = 0; q < p; q++)
+        for (i = 0; i < loc_n; i++)
+            for (j = 0; j < loc_n; j++)
+                loc_mat[((size_t)q * loc_n + j) * loc_n + i] =
+                    buf[((size_t)q * loc_n + i) * loc_n + j];
+    free(buf);
+}
+
+/* The n potentials of -potential on every process, read by process 0;
+ * missing values are 0, which is always consistent */
+dist_t *Read_potential(char *path, idx_t n, int my_rank, MPI_Comm comm)
+{
+    FILE *fp;
+    dist_t *h = calloc(n, sizeof(dist_t));
+    idx_t v = 0;
+
+    if (my_rank == 0)
+    {
+        fp = fopen(path, "r");
+        if (fp == NULL)
+            fprintf(stderr, "Can't open potential file %s\n", path);
+        else
+        {
+            while (v < n && fscanf(fp, DIST_SCAN_FMT, &h[v]) == 1)
+                v++;
+            fclose(fp);
+        }
+        if (v < n)
+            fprintf(stderr, "Potential file has " IDX_FMT " of " IDX_FMT " values\n", v, n);
+    }
+    MPI_Bcast(h, n, MPI_DIST_T, 0, comm);
+    return h;
+}
+
+/* -landmarks: k farthest point landmarks and their distances to and
+ * from the local vertices, see ALT in the header.  Fewer than k when
+ * every reachable vertex is a landmark already */
+void Build_alt(dist_t loc_mat[], idx_t n, idx_t loc_n, int k, Alt_index *alt, MPI_Comm comm)
+{
+    dist_t *key, *d;
+    idx_t *loc_pred, loc_v;
+    Dist_loc my_far, far, *all;
+    int my_rank, p, i, q;
+
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_size(comm, &p);
+    if (k > n)
+        k = n;
+    key = malloc(loc_n * sizeof(dist_t));
+    loc_pred = malloc(loc_n * sizeof(idx_t));
+    all = malloc(p * sizeof(Dist_loc));
+    alt->landmarks = malloc(k * sizeof(idx_t));
+    alt->loc_dist = malloc((size_t)2 * k * loc_n * sizeof(dist_t));
+
+    /* key = distance from the nearest landmark, from vertex 0 at first */
+    Dijkstra(loc_mat, 0, key, loc_pred, loc_n, n, comm);
+    for (i = 0; i < k; i++)
+    {
+        my_far.dist = -1;
+        my_far.v = -1;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (key[loc_v] != DIST_INF && key[loc_v] > my_far.dist)
+            {
+                my_far.dist = key[loc_v];
+                my_far.v = loc_v + my_rank * loc_n;
+            }
+        /* MINLOC can't give the largest, and p pairs are few */
+        MPI_Allgather(&my_far, 1, dist_loc_mpi_t, all, 1, dist_loc_mpi_t, comm);
+        far = all[0];
+        for (q = 1; q < p; q++)
+            if (all[q].dist > far.dist)
+                far = all[q];
+        if (far.v < 0 || (i > 0 && far.dist == 0))
+            break;
+
+        alt->landmarks[i] = far.v;
+        d = &alt->loc_dist[(size_t)i * loc_n];
+        Dijkstra(loc_mat, far.v, d, loc_pred, loc_n, n, comm);
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (i == 0 || d[loc_v] < key[loc_v])
+                key[loc_v] = d[loc_v];
+    }
+    alt->k = i;
+
+    /* d(v, L) is d(L, v) in the reversed graph */
+    Transpose_blk_cols(loc_mat, n, loc_n, comm);
+    for (i = 0; i < alt->k; i++)
+        Dijkstra(loc_mat, alt->landmarks[i], &alt->loc_dist[(size_t)(alt->k + i) * loc_n],
+                 loc_pred, loc_n, n, comm);
+    Transpose_blk_cols(loc_mat, n, loc_n, comm);
+
+    free(key);
+    free(loc_pred);
+    free(all);
+}
+
+/* The file view of this process' columns of the 2k rows of n distances,
+ * and the type of one local row of them */
+static MPI_Datatype Alt_file_type(Alt_index *alt, idx_t n, idx_t loc_n, MPI_Datatype *row_mpi_t)
+{
+    MPI_Datatype file_mpi_t;
+
+    MPI_Type_vector(2 * alt->k, loc_n, n, MPI_DIST_T, &file_mpi_t);
+    MPI_Type_commit(&file_mpi_t);
+    MPI_Type_contiguous(loc_n, MPI_DIST_T, row_mpi_t);
+    MPI_Type_commit(row_mpi_t);
+    return file_mpi_t;
+}
+
+void Write_alt(char *path, Alt_index *alt, idx_t n, idx_t loc_n, MPI_Comm comm)
+{
+    MPI_File fh;
+    MPI_Datatype file_mpi_t, row_mpi_t;
+    MPI_Offset disp;
+    char header[ALT_HEADER_SIZE];
+    int my_rank, i, elem_size = sizeof(dist_t);
+    long long ll_n = n, k = alt->k, *landmarks;
+
+    MPI_Comm_rank(comm, &my_rank);
+    if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) !=
+        MPI_SUCCESS)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "Can't write the ALT index %s\n", path);
+        return;
+    }
+    MPI_File_set_size(fh, 0);
+    if (my_rank == 0)
+    {
+        memcpy(header, ALT_MAGIC, 4);
+        memcpy(header + 4, &elem_size, sizeof(int));
+        memcpy(header + 8, &ll_n, sizeof(long long));
+        memcpy(header + 16, &k, sizeof(long long));
+        landmarks = malloc((k + 1) * sizeof(long long));
+        for (i = 0; i < k; i++)
+            landmarks[i] = alt->landmarks[i];
+        MPI_File_write_at(fh, 0, header, ALT_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at(fh, ALT_HEADER_SIZE, landmarks, k, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+        free(landmarks);
+    }
+
+    disp = ALT_HEADER_SIZE + k * sizeof(long long) + (MPI_Offset)my_rank * loc_n * sizeof(dist_t);
+    file_mpi_t = Alt_file_type(alt, n, loc_n, &row_mpi_t);
+    MPI_File_set_view(fh, disp, MPI_DIST_T, file_mpi_t, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, alt->loc_dist, 2 * alt->k, row_mpi_t, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row_mpi_t);
+    MPI_Type_free(&file_mpi_t);
+    MPI_File_close(&fh);
+}
+
+/* -alt without -landmarks, 1 if path is not an index of this graph */
+int Read_alt(char *path, Alt_index *alt, idx_t n, idx_t loc_n, MPI_Comm comm)
+{
+    MPI_File fh;
+    MPI_Datatype file_mpi_t, row_mpi_t;
+    MPI_Offset disp;
+    char header[ALT_HEADER_SIZE];
+    int my_rank, i, elem_size;
+    long long file_n, k, *landmarks;
+
+    MPI_Comm_rank(comm, &my_rank);
+    alt->k = 0;
+    alt->landmarks = NULL;
+    alt->loc_dist = NULL;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        return 1;
+    MPI_File_read_at_all(fh, 0, header, ALT_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+    memcpy(&elem_size, header + 4, sizeof(int));
+    memcpy(&file_n, header + 8, sizeof(long long));
+    memcpy(&k, header + 16, sizeof(long long));
+    if (memcmp(header, ALT_MAGIC, 4) != 0 || elem_size != sizeof(dist_t) || file_n != n ||
+        k <= 0 || k > n)
+    {
+        MPI_File_close(&fh);
+        return 1;
+    }
+
+    alt->k = k;
+    alt->landmarks = malloc(k * sizeof(idx_t));
+    alt->loc_dist = malloc((size_t)2 * k * loc_n * sizeof(dist_t));
+    landmarks = malloc(k * sizeof(long long));
+    MPI_File_read_at_all(fh, ALT_HEADER_SIZE, landmarks, k, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+    for (i = 0; i < k; i++)
+        alt->landmarks[i] = landmarks[i];
+    free(landmarks);
+
+    disp = ALT_HEADER_SIZE + k * sizeof(long long) + (MPI_Offset)my_rank * loc_n * sizeof(dist_t);
+    file_mpi_t = Alt_file_type(alt, n, loc_n, &row_mpi_t);
+    MPI_File_set_view(fh, disp, MPI_DIST_T, file_mpi_t, "native", MPI_INFO_NULL);
+    MPI_File_read_all(fh, alt->loc_dist, 2 * k, row_mpi_t, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row_mpi_t);
+    MPI_Type_free(&file_mpi_t);
+    MPI_File_close(&fh);
+    return 0;
+}
+
+/* The lower bounds on d(v, tgt) of all n vertices on every process.
+ * A bound is skipped where a distance it needs is infinite */
+dist_t *Alt_potential(Alt_index *alt, idx_t tgt, idx_t n, idx_t loc_n, MPI_Comm comm)
+{
+    dist_t *h = malloc(n * sizeof(dist_t)), *at_tgt, to_v, from_v, lb;
+    idx_t loc_v;
+    int my_rank, i, k = alt->k;
+
+    MPI_Comm_rank(comm, &my_rank);
+    at_tgt = malloc(2 * k * sizeof(dist_t));
+    if (tgt / loc_n == my_rank)
+        for (i = 0; i < 2 * k; i++)
+            at_tgt[i] = alt->loc_dist[(size_t)i * loc_n + tgt % loc_n];
+    MPI_Bcast(at_tgt, 2 * k, MPI_DIST_T, tgt / loc_n, comm);
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        lb = 0;
+        for (i = 0; i < k; i++)
+        {
+            to_v = alt->loc_dist[(size_t)i * loc_n + loc_v];
+            from_v = alt->loc_dist[(size_t)(k + i) * loc_n + loc_v];
+            if (at_tgt[i] != DIST_INF && to_v != DIST_INF && at_tgt[i] - to_v > lb)
+                lb = at_tgt[i] - to_v;
+            if (from_v != DIST_INF && at_tgt[k + i] != DIST_INF && from_v - at_tgt[k + i] > lb)
+                lb = from_v - at_tgt[k + i];
+        }
+        h[(size_t)my_rank * loc_n + loc_v] = lb;
+    }
+    MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, h, loc_n, MPI_DIST_T, comm);
+    free(at_tgt);
+    return h;
+}
+
+void Free_alt(Alt_index *alt)
+{
+    free(alt->landmarks);
+    free(alt->loc_dist);
+    alt->landmarks = NULL;
+    alt->loc_dist = NULL;
+    alt->k = 0;
+}
+
+/* The distance and path of one -t query.  fwd_pred is the tree from src;
+ * with -bidir rev_pred is the tree of the reversed search, whose
+ * predecessors are the next vertices towards tgt, and the path goes
+ * through best->v */
+void Print_p2p(idx_t fwd_pred[], idx_t rev_pred[], idx_t src, idx_t tgt, Dist_loc *best,
+               long long settled[], double time, idx_t n, FILE *output_file)
+{
+    idx_t *path = malloc(n * sizeof(idx_t)), count = 0, w, i;
+
+    if (best->dist == DIST_INF)
+        fprintf(output_file, "dist " IDX_FMT "->" IDX_FMT ": inf\n", src, tgt);
+    else
+        fprintf(output_file, "dist " IDX_FMT "->" IDX_FMT ": " DIST_FMT "\n", src, tgt,
+                best->dist);
+    fprintf(output_file, "Path " IDX_FMT "->" IDX_FMT ":", src, tgt);
+    if (best->dist != DIST_INF)
+    {
+        for (w = best->v; w != src; w = fwd_pred[w])
+            path[count++] = w;
+        fprintf(output_file, " " IDX_FMT, src);
+        for (i = count - 1; i >= 0; i--)
+            fprintf(output_file, " " IDX_FMT, path[i]);
+        if (rev_pred != NULL)
+            for (w = best->v; w != tgt;)
+            {
+                w = rev_pred[w];
+                fprintf(output_file, " " IDX_FMT, w);
+            }
+    }
+    fprintf(output_file, "\n");
+    if (rev_pred != NULL)
+        fprintf(output_file, "settled: %lld (%lld forward, %lld reverse), t: %f s\n\n",
+                settled[0] + settled[1], settled[0], settled[1], time);
+    else
+        fprintf(output_file, "settled: %lld, t: %f s\n\n", settled[0], time);
+    free(path);
+}
+
+/* Dijkstra from the BATCH sources srcs at once with the distances,
+ * predecessors and known flags of vertex v for all sources next to each
+ * other at [v * BATCH + s].  A source whose search is over takes part
+ * with distance DIST_INF, which relaxes nothing */
+void Dijkstra_batch(dist_t loc_mat[], idx_t srcs[], dist_t loc_dist[], idx_t loc_pred[],
+                    idx_t loc_n, idx_t n, MPI_Comm comm)
+{
+    idx_t i, loc_v, u[BATCH];
+    dist_t d[BATCH];
+    int my_rank, b, active;
+    int *loc_known;
+    Dist_loc my_min[BATCH], glbl_min[BATCH];
+
+    MPI_Comm_rank(comm, &my_rank);
+    loc_known = malloc((size_t)loc_n * BATCH * sizeof(int));
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        for (b = 0; b < BATCH; b++)
+        {
+            loc_dist[loc_v * BATCH + b] = loc_mat[(size_t)srcs[b] * loc_n + loc_v];
+            loc_pred[loc_v * BATCH + b] = srcs[b];
+            loc_known[loc_v * BATCH + b] = 0;
+        }
+    for (b = 0; b < BATCH; b++)
+    {
+        if (srcs[b] / loc_n == my_rank)
+            loc_known[(srcs[b] % loc_n) * BATCH + b] = -1;
+        my_min[b].dist = DIST_INF;
+        my_min[b].v = -1;
+    }
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        for (b = 0; b < BATCH; b++)
+            if (!loc_known[loc_v * BATCH + b] && loc_dist[loc_v * BATCH + b] < my_min[b].dist)
+            {
+                my_min[b].dist = loc_dist[loc_v * BATCH + b];
+                my_min[b].v = loc_v + my_rank * loc_n;
+            }
+
+    for (i = 0; i < n - 1; i++)
+    {
+        MPI_Allreduce(my_min, glbl_min, BATCH, dist_loc_mpi_t, min_loc_op, comm);
+
+        active = 0;
+        for (b = 0; b < BATCH; b++)
+        {
+            if (glbl_min[b].v == -1)
+            {
+                u[b] = 0;
+                d[b] = DIST_INF;
+                continue;
+            }
+            active = 1;
+            u[b] = glbl_min[b].v;
+            d[b] = glbl_min[b].dist;
+            if (u[b] / loc_n == my_rank)
+                loc_known[(u[b] % loc_n) * BATCH + b] = -1;
+        }
+        if (!active)
+            break;
+
+        Relax_batch(loc_mat, u, d, loc_dist, loc_pred, loc_known, loc_n, my_min, my_rank);
+    }
+    free(loc_known);
+}
+
+/* Relax_find_min for all sources of a batch: source b relaxes from u[b]
+ * with distance d[b], and my_min[b] gets its unknown local vertex with
+ * the smallest new distance (v = -1 if there is none).  In the vector
+ * loop lane b is source b and the BATCH weights of vertex v are
+ * gathered from rows u[b], with 32-bit offsets u[b] * loc_n; the scalar
+ * loop takes over when they don't fit */
+void Relax_batch(dist_t loc_mat[], idx_t u[], dist_t d[], dist_t loc_dist[],
+                 idx_t loc_pred[], int loc_known[], idx_t loc_n, Dist_loc my_min[],
+                 int my_rank)
+{
+    idx_t loc_v, k;
+    dist_t new_dist, *dist;
+    int b, better;
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+    int offs[BATCH], lane_min[BATCH], lane_idx[BATCH], use_simd = 1;
+#endif
+
+    for (b = 0; b < BATCH; b++)
+    {
+        my_min[b].dist = DIST_INF;
+        my_min[b].v = -1;
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+        if ((double)u[b] * loc_n > INT_MAX)
+            use_simd = 0;
+#endif
+    }
+#if defined(SIMD_AVX512)
+    if (use_simd)
+    {
+        __m512i du, limv, inf = _mm512_set1_epi32(DIST_INF), uv, ones = _mm512_set1_epi32(-1);
+        __m512i minv = inf, mini = ones, vv, offv, w, dv, cand;
+        __mmask16 sat, less, unknown;
+
+        for (b = 0; b < BATCH; b++)
+        {
+            offs[b] = u[b] * loc_n;
+            lane_min[b] = DIST_INF - d[b];
+        }
+        du = _mm512_loadu_si512(d);
+        limv = _mm512_loadu_si512(lane_min);
+        uv = _mm512_loadu_si512(u);
+        offv = _mm512_loadu_si512(offs);
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        {
+            k = loc_v * BATCH;
+            w = _mm512_i32gather_epi32(offv, &loc_mat[loc_v], 4);
+            dv = _mm512_loadu_si512(&loc_dist[k]);
+            sat = _mm512_cmpgt_epi32_mask(w, limv);
+            cand = _mm512_mask_mov_epi32(_mm512_add_epi32(du, w), sat, inf);
+            less = _mm512_cmplt_epi32_mask(cand, dv);
+            dv = _mm512_mask_mov_epi32(dv, less, cand);
+            _mm512_storeu_si512(&loc_dist[k], dv);
+            _mm512_mask_storeu_epi32(&loc_pred[k], less, uv);
+
+            unknown = _mm512_testn_epi32_mask(_mm512_loadu_si512(&loc_known[k]), ones);
+            less = _mm512_mask_cmplt_epi32_mask(unknown, dv, minv);
+            vv = _mm512_set1_epi32(loc_v);
+            minv = _mm512_mask_mov_epi32(minv, less, dv);
+            mini = _mm512_mask_mov_epi32(mini, less, vv);
+        }
+        _mm512_storeu_si512(lane_min, minv);
+        _mm512_storeu_si512(lane_idx, mini);
+        for (b = 0; b < BATCH; b++)
+            if (lane_idx[b] >= 0)
+            {
+                my_min[b].dist = lane_min[b];
+                my_min[b].v = lane_idx[b] + my_rank * loc_n;
+            }
+        return;
+    }
+#elif defined(SIMD_AVX2)
+    if (use_simd)
+    {
+        __m256i du, limv, inf = _mm256_set1_epi32(DIST_INF), uv;
+        __m256i minv = inf, mini = _mm256_set1_epi32(-1), offv, w, dv, pr, sat, cand, less, keyv;
+
+        for (b = 0; b < BATCH; b++)
+        {
+            offs[b] = u[b] * loc_n;
+            lane_min[b] = DIST_INF - d[b];
+        }
+        du = _mm256_loadu_si256((__m256i *)d);
+        limv = _mm256_loadu_si256((__m256i *)lane_min);
+        uv = _mm256_loadu_si256((__m256i *)u);
+        offv = _mm256_loadu_si256((__m256i *)offs);
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        {
+            k = loc_v * BATCH;
+            w = _mm256_i32gather_epi32(&loc_mat[loc_v], offv, 4);
+            dv = _mm256_loadu_si256((__m256i *)&loc_dist[k]);
+            pr = _mm256_loadu_si256((__m256i *)&loc_pred[k]);
+            sat = _mm256_cmpgt_epi32(w, limv);
+            cand = _mm256_blendv_epi8(_mm256_add_epi32(du, w), inf, sat);
+            less = _mm256_cmpgt_epi32(dv, cand);
+            dv = _mm256_blendv_epi8(dv, cand, less);
+            _mm256_storeu_si256((__m256i *)&loc_dist[k], dv);
+            _mm256_storeu_si256((__m256i *)&loc_pred[k], _mm256_blendv_epi8(pr, uv, less));
+
+            keyv = _mm256_blendv_epi8(dv, inf, _mm256_loadu_si256((__m256i *)&loc_known[k]));
+            less = _mm256_cmpgt_epi32(minv, keyv);
+            minv = _mm256_blendv_epi8(minv, keyv, less);
+            mini = _mm256_blendv_epi8(mini, _mm256_set1_epi32(loc_v), less);
+        }
+        _mm256_storeu_si256((__m256i *)lane_min, minv);
+        _mm256_storeu_si256((__m256i *)lane_idx, mini);
+        for (b = 0; b < BATCH; b++)
+            if (lane_idx[b] >= 0)
+            {
+                my_min[b].dist = lane_min[b];
+                my_min[b].v = lane_idx[b] + my_rank * loc_n;
+            }
+        return;
+    }
+#endif
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        k = loc_v * BATCH;
+        dist = &loc_dist[k];
+        for (b = 0; b < BATCH; b++)
+        {
+            new_dist = Sat_add(d[b], loc_mat[(size_t)u[b] * loc_n + loc_v]);
+            better = new_dist < dist[b];
+            dist[b] = better ? new_dist : dist[b];
+            loc_pred[k + b] = better ? u[b] : loc_pred[k + b];
+            if (!loc_known[k + b] && dist[b] < my_min[b].dist)
+            {
+                my_min[b].dist = dist[b];
+                my_min[b].v = loc_v + my_rank * loc_n;
+            }
+        }
+    }
+}
+
+/* Global row / column of a local one and local row / column of a global
+ * one on the grid, see Grid_2d */
+static inline idx_t Grid_glbl_row(Grid_2d *grid, idx_t li)
+{
+    return ((li / grid->nb) * grid->pr + grid->my_r) * grid->nb + li % grid->nb;
+}
+
+static inline idx_t Grid_glbl_col(Grid_2d *grid, idx_t lj)
+{
+    return ((lj / grid->nb) * grid->pc + grid->my_c) * grid->nb + lj % grid->nb;
+}
+
+static inline idx_t Grid_loc_row(Grid_2d *grid, idx_t i)
+{
+    return (i / grid->nb / grid->pr) * grid->nb + i % grid->nb;
+}
+
+static inline idx_t Grid_loc_col(Grid_2d *grid, idx_t j)
+{
+    return (j / grid->nb / grid->pc) * grid->nb + j % grid->nb;
+}
+
+/* Sets up the pr x pc grid (MPI_Dims_create, MPI_Cart_create without
+ * reordering so rank = my_r * pc + my_c) and the block size: the largest
+ * power of two up to APSP_BLOCK that divides n and still gives every
+ * grid row and column at least one block if possible */
+void Build_grid_2d(idx_t n, int p, int my_rank, Grid_2d *grid)
+{
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    int row_dims[2] = {0, 1}, col_dims[2] = {1, 0};
+    idx_t nb;
+
+    MPI_Dims_create(p, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid->cart_comm);
+    MPI_Cart_coords(grid->cart_comm, my_rank, 2, coords);
+    grid->n = n;
+    grid->pr = dims[0];
+    grid->pc = dims[1];
+    grid->my_r = coords[0];
+    grid->my_c = coords[1];
+
+    for (nb = APSP_BLOCK; nb > 1; nb /= 2)
+        if (n % nb == 0 && n / nb >= grid->pr && n / nb >= grid->pc)
+            break;
+    while (n % nb != 0)
+        nb /= 2;
+    grid->nb = nb;
+    grid->n_blk = n / nb;
+
+    grid->loc_rows = (grid->n_blk / grid->pr + (grid->my_r < grid->n_blk % grid->pr)) * nb;
+    grid->loc_cols = (grid->n_blk / grid->pc + (grid->my_c < grid->n_blk % grid->pc)) * nb;
+
+    MPI_Cart_sub(grid->cart_comm, row_dims, &grid->row_comm);
+    MPI_Cart_sub(grid->cart_comm, col_dims, &grid->col_comm);
+}
+
+void Free_grid_2d(Grid_2d *grid)
+{
+    MPI_Comm_free(&grid->row_comm);
+    MPI_Comm_free(&grid->col_comm);
+    MPI_Comm_free(&grid->cart_comm);
+}
+
+/* Moves the n x loc_n column blocks into the 2D block-cyclic arrays.
+ * Both sides walk their elements row by row, so the elements a process
+ * receives from one sender arrive in the order it stores them and no
+ * indices are sent */
+void Blk_col_to_2d(dist_t loc_mat[], idx_t loc_n, Grid_2d *grid, dist_t a[],
+                   int my_rank, MPI_Comm comm)
+{
+    idx_t n = grid->n, nb = grid->nb, i, j, li, lj;
+    int p, q, *send_counts, *recv_counts, *send_displs, *recv_displs, *pos;
+    dist_t *send_buf, *recv_buf;
+
+    MPI_Comm_size(comm, &p);
+    send_counts = calloc(p, sizeof(int));
+    recv_counts = calloc(p, sizeof(int));
+    send_displs = malloc(p * sizeof(int));
+    recv_displs = malloc(p * sizeof(int));
+    pos = malloc(p * sizeof(int));
+    send_buf = malloc((size_t)n * loc_n * sizeof(dist_t) + 1);
+    recv_buf = malloc((size_t)grid->loc_rows * grid->loc_cols * sizeof(dist_t) + 1);
+
+#define OWNER_2D(i, j) ((int)(((i) / nb) % grid->pr) * grid->pc + (int)(((j) / nb) % grid->pc))
+    for (i = 0; i < n; i++)
+        for (j = my_rank * loc_n; j < (my_rank + 1) * loc_n; j++)
+            send_counts[OWNER_2D(i, j)]++;
+    for (li = 0; li < grid->loc_rows; li++)
+        for (lj = 0; lj < grid->loc_cols; lj++)
+            recv_counts[Grid_glbl_col(grid, lj) / loc_n]++;
+    for (q = 0, send_displs[0] = recv_displs[0] = 0; q < p - 1; q++)
+    {
+        send_displs[q + 1] = send_displs[q] + send_counts[q];
+        recv_displs[q + 1] = recv_displs[q] + recv_counts[q];
+    }
+
+    memcpy(pos, send_displs, p * sizeof(int));
+    for (i = 0; i < n; i++)
+        for (j = my_rank * loc_n; j < (my_rank + 1) * loc_n; j++)
+            send_buf[pos[OWNER_2D(i, j)]++] = loc_mat[(size_t)i * loc_n + j - my_rank * loc_n];
+#undef OWNER_2D
+
+    MPI_Alltoallv(send_buf, send_counts, send_displs, MPI_DIST_T,
+                  recv_buf, recv_counts, recv_displs, MPI_DIST_T, comm);
+
+    memcpy(pos, recv_displs, p * sizeof(int));
+    for (li = 0; li < grid->loc_rows; li++)
+        for (lj = 0; lj < grid->loc_cols; lj++)
+            a[(size_t)li * grid->loc_cols + lj] = recv_buf[pos[Grid_glbl_col(grid, lj) / loc_n]++];
+
+    free(send_counts);
+    free(recv_counts);
+    free(send_displs);
+    free(recv_displs);
+    free(pos);
+    free(send_buf);
+    free(recv_buf);
+}
+
+/* Blocked Floyd-Warshall on the 2D block-cyclic array a, see APSP in
+ * the header.  The diagonal has to be 0 so that the panel and the full
+ * updates can run in place */
+void Floyd_warshall_2d(dist_t a[], Grid_2d *grid)
+{
+    idx_t nb = grid->nb, K, i, k, row_off, col_off;
+    idx_t loc_rows = grid->loc_rows, loc_cols = grid->loc_cols;
+    int r_k, c_k;
+    dist_t *dkk, *col_panel, *row_panel;
+
+    /* d(i, i) = 0 whatever the input says */
+    for (i = 0; i < loc_rows; i++)
+    {
+        K = Grid_glbl_row(grid, i);
+        if ((K / nb) % grid->pc == grid->my_c)
+            a[(size_t)i * loc_cols + Grid_loc_col(grid, K)] = 0;
+    }
+
+    dkk = malloc(nb * nb * sizeof(dist_t));
+    col_panel = malloc((size_t)loc_rows * nb * sizeof(dist_t) + 1);
+    row_panel = malloc((size_t)nb * loc_cols * sizeof(dist_t) + 1);
+
+    for (K = 0; K < grid->n_blk; K++)
+    {
+        r_k = K % grid->pr;
+        c_k = K % grid->pc;
+        /* local offsets of block row / column K on its owners */
+        row_off = (K / grid->pr) * nb;
+        col_off = (K / grid->pc) * nb;
+
+        if (grid->my_r == r_k && grid->my_c == c_k)
+        {
+            for (i = 0; i < nb; i++)
+                memcpy(&dkk[i * nb], &a[(size_t)(row_off + i) * loc_cols + col_off],
+                       nb * sizeof(dist_t));
+            for (k = 0; k < nb; k++)
+                Minplus_block(dkk, nb, &dkk[k], nb, &dkk[k * nb], nb, nb, nb, 1);
+            for (i = 0; i < nb; i++)
+                memcpy(&a[(size_t)(row_off + i) * loc_cols + col_off], &dkk[i * nb],
+                       nb * sizeof(dist_t));
+        }
+
+        /* panels K: row panel = dkk (x) row panel, column panel = column
+         * panel (x) dkk */
+        if (grid->my_r == r_k)
+        {
+            MPI_Bcast(dkk, nb * nb, MPI_DIST_T, c_k, grid->row_comm);
+            Minplus_block(&a[(size_t)row_off * loc_cols], loc_cols, dkk, nb,
+                          &a[(size_t)row_off * loc_cols], loc_cols, nb, loc_cols, nb);
+            memcpy(row_panel, &a[(size_t)row_off * loc_cols], nb * loc_cols * sizeof(dist_t));
+        }
+        if (grid->my_c == c_k)
+        {
+            MPI_Bcast(dkk, nb * nb, MPI_DIST_T, r_k, grid->col_comm);
+            Minplus_block(&a[col_off], loc_cols, &a[col_off], loc_cols, dkk, nb,
+                          loc_rows, nb, nb);
+            for (i = 0; i < loc_rows; i++)
+                memcpy(&col_panel[i * nb], &a[(size_t)i * loc_cols + col_off],
+                       nb * sizeof(dist_t));
+        }
+        MPI_Bcast(col_panel, loc_rows * nb, MPI_DIST_T, c_k, grid->row_comm);
+        MPI_Bcast(row_panel, nb * loc_cols, MPI_DIST_T, r_k, grid->col_comm);
+
+        /* blocks in row or column K only get what they already have */
+        Minplus_block(a, loc_cols, col_panel, nb, row_panel, loc_cols,
+                      loc_rows, loc_cols, nb);
+    }
+    free(dkk);
+    free(col_panel);
+    free(row_panel);
+}
+
+/* Dijkstra from src on the grid, see 2D in the header.  loc_dist and
+ * loc_pred are the loc_cols vertices of my grid column.  The loop
+ * relaxes from the vertex settled last, starting with src at 0, and then
+ * settles the next one until no unknown vertex is reachable */
+void Dijkstra_2d(dist_t a[], Grid_2d *grid, idx_t src, dist_t loc_dist[], idx_t loc_pred[])
+{
+    idx_t loc_cols = grid->loc_cols, lj, loc_u, glbl_u = src;
+    dist_t *row, dist_u = 0;
+    int *loc_known, r_u;
+    Dist_loc my_min, glbl_min;
+
+    loc_known = malloc(loc_cols * sizeof(int));
+    row = malloc(loc_cols * sizeof(dist_t));
+    for (lj = 0; lj < loc_cols; lj++)
+    {
+        loc_dist[lj] = DIST_INF;
+        loc_pred[lj] = src;
+        loc_known[lj] = 0;
+    }
+
+    while (1)
+    {
+        /* every process of the column holding glbl_u marks it */
+        if ((glbl_u / grid->nb) % grid->pc == grid->my_c)
+        {
+            loc_dist[Grid_loc_col(grid, glbl_u)] = dist_u;
+            loc_known[Grid_loc_col(grid, glbl_u)] = -1;
+        }
+
+        r_u = (glbl_u / grid->nb) % grid->pr;
+        if (grid->my_r == r_u)
+            memcpy(row, &a[(size_t)Grid_loc_row(grid, glbl_u) * loc_cols],
+                   loc_cols * sizeof(dist_t));
+        MPI_Bcast(row, loc_cols, MPI_DIST_T, r_u, grid->col_comm);
+        loc_u = Relax_find_min_par(row, dist_u, glbl_u, loc_dist, loc_pred, loc_known, loc_cols);
+
+        if (loc_u != -1)
+        {
+            my_min.dist = loc_dist[loc_u];
+            my_min.v = Grid_glbl_col(grid, loc_u);
+        }
+        else
+        {
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
+        }
+        MPI_Allreduce(&my_min, &glbl_min, 1, dist_loc_mpi_t, min_loc_op, grid->row_comm);
+        if (glbl_min.v == -1)
+            break;
+        glbl_u = glbl_min.v;
+        dist_u = glbl_min.dist;
+    }
+    free(loc_known);
+    free(row);
+}
+
+/* Collects the results of Dijkstra_2d in global order on process 0 from
+ * grid row 0, which has every grid column */
+void Gather_2d(Grid_2d *grid, dist_t loc_dist[], idx_t loc_pred[], dist_t global_dist[],
+               idx_t global_pred[])
+{
+    idx_t nb = grid->nb, n_cols, j, lj;
+    dist_t *all_dist = NULL;
+    idx_t *all_pred = NULL;
+    int c, *counts = NULL, *displs = NULL, loc_cols = grid->loc_cols;
+
+    if (grid->my_r != 0)
+        return;
+    if (grid->my_c == 0)
+    {
+        counts = malloc(grid->pc * sizeof(int));
+        displs = malloc(grid->pc * sizeof(int));
+        all_dist = malloc(grid->n * sizeof(dist_t));
+        all_pred = malloc(grid->n * sizeof(idx_t));
+    }
+    MPI_Gather(&loc_cols, 1, MPI_INT, counts, 1, MPI_INT, 0, grid->row_comm);
+    if (grid->my_c == 0)
+        for (c = 0, displs[0] = 0; c < grid->pc - 1; c++)
+            displs[c + 1] = displs[c] + counts[c];
+    MPI_Gatherv(loc_dist, loc_cols, MPI_DIST_T, all_dist, counts, displs, MPI_DIST_T, 0,
+                grid->row_comm);
+    MPI_Gatherv(loc_pred, loc_cols, MPI_IDX_T, all_pred, counts, displs, MPI_IDX_T, 0,
+                grid->row_comm);
+
+    if (grid->my_c == 0)
+    {
+        for (c = 0; c < grid->pc; c++)
+        {
+            n_cols = counts[c];
+            for (lj = 0; lj < n_cols; lj++)
+            {
+                j = ((lj / nb) * grid->pc + c) * nb + lj % nb;
+                global_dist[j] = all_dist[displs[c] + lj];
+                global_pred[j] = all_pred[displs[c] + lj];
+            }
+        }
+        free(counts);
+        free(displs);
+        free(all_dist);
+        free(all_pred);
+    }
+}
+
+/* c = min(c, a (x) b) in the min-plus semiring for the m x k_len block
+ * a, the k_len x n_cols block b and the m x n_cols block c with leading
+ * dimensions lda, ldb and ldc.  int and float distances go to the blocked
+ * kernels of minplus.h, whose infinities are DIST_INF; c may share rows
+ * with a or b (see Aliasing there) */
+void Minplus_block(dist_t c[], idx_t ldc, dist_t a[], idx_t lda, dist_t b[], idx_t ldb,
+                   idx_t m, idx_t n_cols, idx_t k_len)
+{
+#if defined(DIST_FLOAT)
+    Minplus_gemm_f32(m, n_cols, k_len, a, lda, b, ldb, c, ldc);
+#elif !defined(DIST_INT64)
+    Minplus_gemm_i32(m, n_cols, k_len, a, lda, b, ldb, c, ldc);
+#else
+    idx_t i, j, k;
+    dist_t x, cand;
+
+    for (i = 0; i < m; i++)
+        for (k = 0; k < k_len; k++)
+        {
+            x = a[(size_t)i * lda + k];
+            if (x == DIST_INF)
+                continue;
+            for (j = 0; j < n_cols; j++)
+            {
+                cand = (b[(size_t)k * ldb + j] > DIST_INF - x) ? DIST_INF
+                                                               : x + b[(size_t)k * ldb + j];
+                if (cand < c[(size_t)i * ldc + j])
+                    c[(size_t)i * ldc + j] = cand;
+            }
+        }
+#endif
+}
+
+/* Writes the header of the -bin format on process 0 and then every
+ * process' blocks with one collective write: the darray type is the 2D
+ * block-cyclic distribution of the n x n matrix, so as the file view it
+ * maps the local array straight to its place in the file */
+void Write_apsp(char *path, dist_t a[], Grid_2d *grid, int my_rank, MPI_Comm comm)
+{
+    MPI_File fh;
+    MPI_Datatype file_mpi_t, row_mpi_t;
+    char header[BIN_HEADER_SIZE];
+    int p, elem_size = sizeof(dist_t);
+    int gsizes[2], distribs[2], dargs[2], psizes[2];
+    long long n = grid->n;
+
+    MPI_Comm_size(comm, &p);
+    MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    MPI_File_set_size(fh, 0);
+    if (my_rank == 0)
+    {
+        memcpy(header, BIN_MAGIC, 4);
+        memcpy(header + 4, &elem_size, sizeof(int));
+        memcpy(header + 8, &n, sizeof(long long));
+        MPI_File_write_at(fh, 0, header, BIN_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    gsizes[0] = gsizes[1] = grid->n;
+    distribs[0] = distribs[1] = MPI_DISTRIBUTE_CYCLIC;
+    dargs[0] = dargs[1] = grid->nb;
+    psizes[0] = grid->pr;
+    psizes[1] = grid->pc;
+    MPI_Type_create_darray(p, my_rank, 2, gsizes, distribs, dargs, psizes, MPI_ORDER_C,
+                           MPI_DIST_T, &file_mpi_t);
+    MPI_Type_commit(&file_mpi_t);
+    MPI_File_set_view(fh, BIN_HEADER_SIZE, MPI_DIST_T, file_mpi_t, "native", MPI_INFO_NULL);
+
+    MPI_Type_contiguous(grid->loc_cols, MPI_DIST_T, &row_mpi_t);
+    MPI_Type_commit(&row_mpi_t);
+    MPI_File_write_all(fh, a, grid->loc_rows, row_mpi_t, MPI_STATUS_IGNORE);
+
+    MPI_Type_free(&row_mpi_t);
+    MPI_Type_free(&file_mpi_t);
+    MPI_File_close(&fh);
+}
+
+/* min_in[v] = smallest weight of an edge into the local vertex v and
+ * min_out[v] = smallest weight of an edge out of it, self loops not
+ * counted.  The rows are split over the processes, so the minima of the
+ * local parts of every row are combined with MPI_Reduce_scatter_block,
+ * which leaves each process the minima of its own vertices */
+void Min_in_out(dist_t loc_mat[], idx_t n, idx_t loc_n, dist_t min_in[],
+                dist_t min_out[], int my_rank, MPI_Comm comm)
+{
+    idx_t u, loc_v;
+    dist_t w, *row_min;
+
+    row_min = malloc(n * sizeof(dist_t));
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        min_in[loc_v] = DIST_INF;
+
+    for (u = 0; u < n; u++)
+    {
+        row_min[u] = DIST_INF;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        {
+            if (u == my_rank * loc_n + loc_v)
+                continue;
+            w = loc_mat[(size_t)u * loc_n + loc_v];
+            if (w < row_min[u])
+                row_min[u] = w;
+            if (w < min_in[loc_v])
+                min_in[loc_v] = w;
+        }
+    }
+    MPI_Reduce_scatter_block(row_min, min_out, loc_n, MPI_DIST_T, MPI_MIN, comm);
+    free(row_min);
+}
+
+/* Dijkstra that settles every unknown vertex meeting the IN or OUT
+ * criterion in a round.  Settled vertices keep their distance when more
+ * of them are relaxed in the same round: it is already the shortest one */
+void Dijkstra_multi(dist_t loc_mat[], dist_t min_in[], dist_t min_out[], idx_t src,
+                    dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n, idx_t n,
+                    MPI_Comm comm, long long *rounds_p)
+{
+    idx_t loc_v, i, first, len;
+    dist_t my_bounds[2], bounds[2];
+    int my_rank, p, q, my_count, total;
+    int *loc_known, *counts, *displs;
+    Dist_loc *my_settled, *settled;
+
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_size(comm, &p);
+    loc_known = malloc(loc_n * sizeof(int));
+    my_settled = malloc(loc_n * sizeof(Dist_loc));
+    settled = malloc(n * sizeof(Dist_loc));
+    counts = malloc(p * sizeof(int));
+    displs = malloc(p * sizeof(int));
+
+    Dijkstra_Init(loc_mat, src, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    *rounds_p = 0;
+
+    while (1)
+    {
+        /* L and the OUT bound over the unknown vertices */
+        my_bounds[0] = my_bounds[1] = DIST_INF;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (!loc_known[loc_v])
+            {
+                if (loc_dist[loc_v] < my_bounds[0])
+                    my_bounds[0] = loc_dist[loc_v];
+                if (Sat_add(loc_dist[loc_v], min_out[loc_v]) < my_bounds[1])
+                    my_bounds[1] = Sat_add(loc_dist[loc_v], min_out[loc_v]);
+            }
+        MPI_Allreduce(my_bounds, bounds, 2, MPI_DIST_T, MPI_MIN, comm);
+        if (bounds[0] == DIST_INF)
+            break;
+
+        my_count = 0;
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (!loc_known[loc_v] && loc_dist[loc_v] != DIST_INF &&
+                (loc_dist[loc_v] <= bounds[1] ||
+                 loc_dist[loc_v] <= Sat_add(bounds[0], min_in[loc_v])))
+            {
+                loc_known[loc_v] = -1;
+                my_settled[my_count].dist = loc_dist[loc_v];
+                my_settled[my_count].v = loc_v + my_rank * loc_n;
+                my_count++;
+            }
+
+        MPI_Allgather(&my_count, 1, MPI_INT, counts, 1, MPI_INT, comm);
+        for (q = 0, total = 0; q < p; q++)
+        {
+            displs[q] = total;
+            total += counts[q];
+        }
+        MPI_Allgatherv(my_settled, my_count, dist_loc_mpi_t, settled, counts, displs,
+                       dist_loc_mpi_t, comm);
+
+        /* each thread relaxes all settled rows on its chunks */
+#ifdef _OPENMP
+#pragma omp parallel for private(i, len) schedule(static) if (loc_n >= 2 * OMP_CHUNK)
+#endif
+        for (first = 0; first < loc_n; first += OMP_CHUNK)
+        {
+            len = (loc_n - first < OMP_CHUNK) ? loc_n - first : OMP_CHUNK;
+            for (i = 0; i < total; i++)
+                Relax_find_min(&loc_mat[(size_t)settled[i].v * loc_n + first], settled[i].dist,
+                               settled[i].v, &loc_dist[first], &loc_pred[first],
+                               &loc_known[first], len);
+        }
+        (*rounds_p)++;
+    }
+    free(displs);
+    free(counts);
+    free(settled);
+    free(my_settled);
+    free(loc_known);
+}
+
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+/* Merges the per lane (min, index) pairs of the vector loops into
+ * *shortest_p / *loc_u_p, keeping the smallest index on ties */
+static void Merge_lanes(int lane_min[], int lane_idx[], int lanes,
+                        dist_t *shortest_p, idx_t *loc_u_p)
+{
+    int lane;
+
+    for (lane = 0; lane < lanes; lane++)
+        if (lane_idx[lane] >= 0 &&
+            (lane_min[lane] < *shortest_p ||
+             (lane_min[lane] == *shortest_p && lane_idx[lane] < *loc_u_p)))
+        {
+            *shortest_p = lane_min[lane];
+            *loc_u_p = lane_idx[lane];
+        }
+}
+#endif
+
+/* Relax_find_min with the OpenMP threads of the process, each doing its
+ * OMP_CHUNK vertex chunks and keeping the argmin of them, and the thread
+ * argmins merged by (distance, vertex) so the result is the serial one */
+idx_t Relax_find_min_par(dist_t row[], dist_t dist_u, idx_t glbl_u, dist_t loc_dist[],
+                         idx_t loc_pred[], int loc_known[], idx_t loc_n)
+{
+#ifdef _OPENMP
+    idx_t loc_u = -1;
+
+    if (loc_n < 2 * OMP_CHUNK || omp_get_max_threads() == 1)
+        return Relax_find_min(row, dist_u, glbl_u, loc_dist, loc_pred, loc_known, loc_n);
+#pragma omp parallel
+    {
+        idx_t first, len, u, my_u = -1;
+
+        /* static chunks are in increasing order per thread, so the strict
+         * comparison keeps the smaller vertex on ties */
+#pragma omp for schedule(static) nowait
+        for (first = 0; first < loc_n; first += OMP_CHUNK)
+        {
+            len = (loc_n - first < OMP_CHUNK) ? loc_n - first : OMP_CHUNK;
+            u = Relax_find_min(&row[first], dist_u, glbl_u, &loc_dist[first], &loc_pred[first],
+                               &loc_known[first], len);
+            if (u != -1 && (my_u == -1 || loc_dist[first + u] < loc_dist[my_u]))
+                my_u = first + u;
+        }
+#pragma omp critical
+        if (my_u != -1 &&
+            (loc_u == -1 || loc_dist[my_u] < loc_dist[loc_u] ||
+             (loc_dist[my_u] == loc_dist[loc_u] && my_u < loc_u)))
+            loc_u = my_u;
+    }
+    return loc_u;
+#else
+    return Relax_find_min(row, dist_u, glbl_u, loc_dist, loc_pred, loc_known, loc_n);
+#endif
+}
+
+/* loc_dist[v] = min(loc_dist[v], dist_u + row[v]) for every local v,
+ * setting loc_pred[v] = glbl_u where it dropped, and returns the unknown
+ * local vertex with the smallest new distance like Find_min_dist.
+ * Known vertices need no test in the update: their distance is
+ * <= dist_u, so with nonnegative weights the strict comparison never
+ * changes them */
+idx_t Relax_find_min(dist_t row[], dist_t dist_u, idx_t glbl_u, dist_t loc_dist[],
+                     idx_t loc_pred[], int loc_known[], idx_t loc_n)
+{
+    idx_t loc_v = 0, loc_u = -1;
+    dist_t lim = DIST_INF - dist_u, new_dist, shortest_dist = DIST_INF;
+    int better;
+#if defined(SIMD_AVX512)
+    int lane_min[16], lane_idx[16];
+    __m512i du = _mm512_set1_epi32(dist_u), limv = _mm512_set1_epi32(lim);
+    __m512i inf = _mm512_set1_epi32(DIST_INF), uv = _mm512_set1_epi32(glbl_u);
+    __m512i minv = inf, mini = _mm512_set1_epi32(-1), ones = _mm512_set1_epi32(-1);
+    __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i step = _mm512_set1_epi32(16), w, d, cand;
+    __mmask16 sat, less, unknown;
+
+    for (; loc_v + 16 <= loc_n; loc_v += 16)
+    {
+        w = _mm512_loadu_si512(&row[loc_v]);
+        d = _mm512_loadu_si512(&loc_dist[loc_v]);
+        sat = _mm512_cmpgt_epi32_mask(w, limv);
+        cand = _mm512_mask_mov_epi32(_mm512_add_epi32(du, w), sat, inf);
+        less = _mm512_cmplt_epi32_mask(cand, d);
+        d = _mm512_mask_mov_epi32(d, less, cand);
+        _mm512_storeu_si512(&loc_dist[loc_v], d);
+        _mm512_mask_storeu_epi32(&loc_pred[loc_v], less, uv);
+
+        unknown = _mm512_testn_epi32_mask(_mm512_loadu_si512(&loc_known[loc_v]), ones);
+        less = _mm512_mask_cmplt_epi32_mask(unknown, d, minv);
+        minv = _mm512_mask_mov_epi32(minv, less, d);
+        mini = _mm512_mask_mov_epi32(mini, less, idx);
+        idx = _mm512_add_epi32(idx, step);
+    }
+    _mm512_storeu_si512(lane_min, minv);
+    _mm512_storeu_si512(lane_idx, mini);
+    Merge_lanes(lane_min, lane_idx, 16, &shortest_dist, &loc_u);
+#elif defined(SIMD_AVX2)
+    int lane_min[8], lane_idx[8];
+    __m256i du = _mm256_set1_epi32(dist_u), limv = _mm256_set1_epi32(lim);
+    __m256i inf = _mm256_set1_epi32(DIST_INF), uv = _mm256_set1_epi32(glbl_u);
+    __m256i minv = inf, mini = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i step = _mm256_set1_epi32(8), w, d, pr, sat, cand, less, keyv;
+
+    for (; loc_v + 8 <= loc_n; loc_v += 8)
+    {
+        w = _mm256_loadu_si256((__m256i *)&row[loc_v]);
+        d = _mm256_loadu_si256((__m256i *)&loc_dist[loc_v]);
+        pr = _mm256_loadu_si256((__m256i *)&loc_pred[loc_v]);
+        sat = _mm256_cmpgt_epi32(w, limv);
+        cand = _mm256_blendv_epi8(_mm256_add_epi32(du, w), inf, sat);
+        less = _mm256_cmpgt_epi32(d, cand);
+        d = _mm256_blendv_epi8(d, cand, less);
+        _mm256_storeu_si256((__m256i *)&loc_dist[loc_v], d);
+        _mm256_storeu_si256((__m256i *)&loc_pred[loc_v], _mm256_blendv_epi8(pr, uv, less));
+
+        keyv = _mm256_blendv_epi8(d, inf, _mm256_loadu_si256((__m256i *)&loc_known[loc_v]));
+        less = _mm256_cmpgt_epi32(minv, keyv);
+        minv = _mm256_blendv_epi8(minv, keyv, less);
+        mini = _mm256_blendv_epi8(mini, idx, less);
+        idx = _mm256_add_epi32(idx, step);
+    }
+    _mm256_storeu_si256((__m256i *)lane_min, minv);
+    _mm256_storeu_si256((__m256i *)lane_idx, mini);
+    Merge_lanes(lane_min, lane_idx, 8, &shortest_dist, &loc_u);
+#endif
+    for (; loc_v < loc_n; loc_v++)
+    {
+        new_dist = (row[loc_v] > lim) ? DIST_INF : dist_u + row[loc_v];
+        better = new_dist < loc_dist[loc_v];
+        loc_dist[loc_v] = better ? new_dist : loc_dist[loc_v];
+        loc_pred[loc_v] = better ? glbl_u : loc_pred[loc_v];
+
+        new_dist = loc_known[loc_v] ? DIST_INF : loc_dist[loc_v];
+        if (new_dist < shortest_dist)
+        {
+            shortest_dist = new_dist;
+            loc_u = loc_v;
+        }
+    }
+    return loc_u;
+}
+
+void Build_loc_csr(dist_t loc_mat[], idx_t n, idx_t loc_n, Loc_csr *csr)
+{
+    idx_t u, loc_v, e;
+    dist_t w;
+
+    /* first pass counts the edges of every row, second pass fills them */
+    csr->row_ptr = malloc((n + 1) * sizeof(idx_t));
+    csr->row_ptr[0] = 0;
+    for (u = 0; u < n; u++)
+    {
+        csr->row_ptr[u + 1] = csr->row_ptr[u];
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+            if (loc_mat[(size_t)u * loc_n + loc_v] < DIST_INF)
+                csr->row_ptr[u + 1]++;
+    }
+    csr->nnz = csr->row_ptr[n];
+    csr->col_idx = malloc((csr->nnz + 1) * sizeof(idx_t));
+    csr->weight = malloc((csr->nnz + 1) * sizeof(dist_t));
+    if (csr->row_ptr == NULL || csr->col_idx == NULL || csr->weight == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    e = 0;
+    for (u = 0; u < n; u++)
+        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        {
+            w = loc_mat[(size_t)u * loc_n + loc_v];
+            if (w < DIST_INF)
+            {
+                csr->col_idx[e] = loc_v;
+                csr->weight[e] = w;
+                e++;
+            }
+        }
+}
+
+/* Returns the lines of the edge file that start in this process' byte
+ * range [my_rank * size / p, (my_rank + 1) * size / p), NUL terminated.
+ * The last line is completed past the end of the range, a line cut at
+ * the start of the range belongs to the previous process */
+/* MPI_File_read_at of len bytes at off in pieces of at most READ_CHUNK,
+ * the count of one call being an int.  Returns the bytes read, fewer at
+ * the end of the file */
+static MPI_Offset Read_at_chunked(MPI_File fh, MPI_Offset off, char *buf, MPI_Offset len)
+{
+    MPI_Offset done = 0;
+    MPI_Status status;
+    int count, got;
+
+    while (done < len)
+    {
+        count = (len - done > READ_CHUNK) ? READ_CHUNK : (int)(len - done);
+        MPI_File_read_at(fh, off + done, buf + done, count, MPI_CHAR, &status);
+        MPI_Get_count(&status, MPI_CHAR, &got);
+        if (got <= 0)
+            break;
+        done += got;
+    }
+    return done;
+}
+
+char *Read_my_lines(MPI_File fh, int my_rank, int p, MPI_Offset *len_p)
+{
+    MPI_Offset size, first, last, buf_start, got, more, i, skip = 0;
+    char *buf;
+
+    MPI_File_get_size(fh, &size);
+    first = size * my_rank / p;
+    last = size * (my_rank + 1) / p;
+    if (first == last)
+    {
+        *len_p = 0;
+        return calloc(1, 1);
+    }
+    /* one byte back to see if the range starts on a line boundary */
+    buf_start = (my_rank > 0) ? first - 1 : 0;
+
+    buf = malloc(last - buf_start + 1);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    got = Read_at_chunked(fh, buf_start, buf, last - buf_start);
+
+    /* complete the line holding the last byte of the range */
+    i = last - 1 - buf_start;
+    for (;;)
+    {
+        while (i < got && buf[i] != '\n')
+            i++;
+        if (i < got || buf_start + got == size)
+            break;
+        more = 4096;
+        if (buf_start + got + more > size)
+            more = size - buf_start - got;
+        buf = realloc(buf, got + more + 1);
+        more = Read_at_chunked(fh, buf_start + got, buf + got, more);
+        if (more == 0)
+            break;
+        got += more;
+    }
+    got = (i < got) ? i + 1 : got;
+    buf[got] = '\0';
+
+    if (my_rank > 0)
+    {
+        while (skip < got && buf[skip] != '\n')
+            skip++;
+        skip++;
+        /* no line starts inside the range */
+        if (buf_start + skip >= last)
+            skip = got;
+    }
+    memmove(buf, buf + skip, got - skip + 1);
+    *len_p = got - skip;
+    return buf;
+}
+
+void Read_edge_list(char *path, idx_t *n_p, idx_t *loc_n_p, Loc_csr *csr,
+                    int my_rank, int p, MPI_Comm comm)
+{
+    MPI_File fh;
+    MPI_Offset len;
+    char *buf, *line, *next, *end;
+    idx_t n, loc_n, n_edges = 0, max_edges = 1024, loc_max = -1, header_n = 0;
+    idx_t nnz, vals[2];
+    dist_t w;
+    int i;
+    Edge *edges, *recv_buf;
+
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "Error opening edge file %s\n", path);
+        MPI_Abort(comm, -1);
+    }
+    buf = Read_my_lines(fh, my_rank, p, &len);
+    MPI_File_close(&fh);
+
+    /* parse "src dst weight" triples */
+    edges = malloc(max_edges * sizeof(Edge));
+    for (line = buf; line < buf + len; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next == NULL)
+            next = buf + len;
+        else
+            *next++ = '\0';
+        if (line[0] == '#' || line[0] == '%')
+            continue;
+
+        for (i = 0; i < 2; i++)
+        {
+            vals[i] = strtoll(line, &end, 10);
+            if (end == line)
+                break;
+            line = end;
+        }
+#ifdef DIST_FLOAT
+        w = strtof(line, &end);
+#else
+        w = strtoll(line, &end, 10);
+#endif
+        if (i == 1 && end == line)
+        {
+            header_n = vals[0];
+            continue;
+        }
+        if (i < 2 || end == line)
+            continue;
+        if (vals[0] < 0 || vals[1] < 0 || w < 0)
+        {
+            fprintf(stderr, "Skipping edge " IDX_FMT " " IDX_FMT " " DIST_FMT "\n", vals[0],
+                    vals[1], w);
+            continue;
+        }
+        if (n_edges == max_edges)
+        {
+            max_edges *= 2;
+            edges = realloc(edges, max_edges * sizeof(Edge));
+        }
+        edges[n_edges].u = vals[0];
+        edges[n_edges].v = vals[1];
+        edges[n_edges].w = w;
+        if (vals[0] > loc_max)
+            loc_max = vals[0];
+        if (vals[1] > loc_max)
+            loc_max = vals[1];
+        n_edges++;
+    }
+    free(buf);
+
+    loc_max++;
+    if (header_n > loc_max)
+        loc_max = header_n;
+    MPI_Allreduce(&loc_max, &n, 1, MPI_IDX_T, MPI_MAX, comm);
+    loc_n = (n + p - 1) / p;
+
+    /* route every edge to the owner of its destination vertex */
+    recv_buf = Route_edges(edges, n_edges, 0, loc_n, comm, &nnz);
+    free(edges);
+
+    Build_csr_from_edges(recv_buf, nnz, n, 0, (idx_t)my_rank * loc_n, csr);
+    free(recv_buf);
+
+    *n_p = n;
+    *loc_n_p = loc_n;
+}
+
+void Free_loc_csr(Loc_csr *csr)
+{
+    free(csr->row_ptr);
+    free(csr->col_idx);
+    free(csr->weight);
+}
+
+/* Sends every edge to the process owning its source (by_src) or its
+ * destination vertex and returns the edges received, *n_recv_p of them */
+Edge *Route_edges(Edge edges[], idx_t n_edges, int by_src, idx_t loc_n,
+                  MPI_Comm comm, idx_t *n_recv_p)
+{
+    MPI_Datatype edge_mpi_t;
+    Edge *send_buf, *recv_buf;
+    int *send_cnt, *recv_cnt, *send_off, *recv_off;
+    idx_t e, n_recv;
+    int p, q;
+
+    MPI_Comm_size(comm, &p);
+    MPI_Type_contiguous(sizeof(Edge), MPI_BYTE, &edge_mpi_t);
+    MPI_Type_commit(&edge_mpi_t);
+    send_cnt = calloc(p, sizeof(int));
+    recv_cnt = malloc(p * sizeof(int));
+    send_off = malloc(p * sizeof(int));
+    recv_off = malloc(p * sizeof(int));
+    for (e = 0; e < n_edges; e++)
+        send_cnt[(by_src ? edges[e].u : edges[e].v) / loc_n]++;
+    MPI_Alltoall(send_cnt, 1, MPI_INT, recv_cnt, 1, MPI_INT, comm);
+
+    send_off[0] = recv_off[0] = 0;
+    for (q = 1; q < p; q++)
+    {
+        send_off[q] = send_off[q - 1] + send_cnt[q - 1];
+        recv_off[q] = recv_off[q - 1] + recv_cnt[q - 1];
+    }
+    send_buf = malloc((n_edges + 1) * sizeof(Edge));
+    for (e = 0; e < n_edges; e++)
+    {
+        q = (by_src ? edges[e].u : edges[e].v) / loc_n;
+        send_buf[send_off[q]++] = edges[e];
+    }
+    for (q = 0; q < p; q++)
+        send_off[q] -= send_cnt[q];
+
+    n_recv = recv_off[p - 1] + recv_cnt[p - 1];
+    recv_buf = malloc((n_recv + 1) * sizeof(Edge));
+    MPI_Alltoallv(send_buf, send_cnt, send_off, edge_mpi_t,
+                  recv_buf, recv_cnt, recv_off, edge_mpi_t, comm);
+
+    free(send_buf);
+    free(send_cnt);
+    free(recv_cnt);
+    free(send_off);
+    free(recv_off);
+    MPI_Type_free(&edge_mpi_t);
+
+    *n_recv_p = n_recv;
+    return recv_buf;
+}
+
+/* Counting sort of edges by source: row u - row_base gets the edges of
+ * u, stored with column v - col_base */
+void Build_csr_from_edges(Edge edges[], idx_t n_edges, idx_t n_rows,
+                          idx_t row_base, idx_t col_base, Loc_csr *csr)
+{
+    idx_t e, u;
+
+    csr->row_ptr = calloc(n_rows + 1, sizeof(idx_t));
+    csr->col_idx = malloc((n_edges + 1) * sizeof(idx_t));
+    csr->weight = malloc((n_edges + 1) * sizeof(dist_t));
+    if (csr->row_ptr == NULL || csr->col_idx == NULL || csr->weight == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (e = 0; e < n_edges; e++)
+        csr->row_ptr[edges[e].u - row_base + 1]++;
+    for (u = 0; u < n_rows; u++)
+        csr->row_ptr[u + 1] += csr->row_ptr[u];
+    for (e = 0; e < n_edges; e++)
+    {
+        u = edges[e].u - row_base;
+        csr->col_idx[csr->row_ptr[u]] = edges[e].v - col_base;
+        csr->weight[csr->row_ptr[u]] = edges[e].w;
+        csr->row_ptr[u]++;
+    }
+    for (u = n_rows; u > 0; u--)
+        csr->row_ptr[u] = csr->row_ptr[u - 1];
+    csr->row_ptr[0] = 0;
+    csr->nnz = n_edges;
+}
+
+/* Regroups the column block CSR (rows: all sources, columns: local
+ * destinations) into the out-edges of the local vertices (rows: local
+ * sources, columns: global destinations) */
+void Transpose_loc_csr(Loc_csr *in, idx_t n, idx_t loc_n, Loc_csr *out,
+                       int my_rank, MPI_Comm comm)
+{
+    Edge *edges, *recv_buf;
+    idx_t u, e, n_recv;
+    idx_t first = (idx_t)my_rank * loc_n;
+
+    edges = malloc((in->nnz + 1) * sizeof(Edge));
+    for (u = 0; u < n; u++)
+        for (e = in->row_ptr[u]; e < in->row_ptr[u + 1]; e++)
+        {
+            edges[e].u = u;
+            edges[e].v = first + in->col_idx[e];
+            edges[e].w = in->weight[e];
+        }
+    recv_buf = Route_edges(edges, in->nnz, 1, loc_n, comm, &n_recv);
+    free(edges);
+
+    Build_csr_from_edges(recv_buf, n_recv, loc_n, first, 0, out);
+    free(recv_buf);
+}
+
+void Bucket_insert(Buckets *b, long long bucket, idx_t v)
+{
+    idx_t slot = bucket % b->n_slots;
+
+    if (b->len[slot] == b->cap[slot])
+    {
+        b->cap[slot] = 2 * b->cap[slot] + 4;
+        b->v[slot] = realloc(b->v[slot], b->cap[slot] * sizeof(idx_t));
+    }
+    b->v[slot][b->len[slot]++] = v;
+}
+
+/* Smallest bucket >= first holding a vertex whose distance is still in
+ * that bucket, or LLONG_MAX.  Stale entries met on the way are dropped */
+long long Next_bucket(Buckets *b, long long first, dist_t loc_dist[], double delta)
+{
+    long long k, bucket;
+    idx_t slot, i, kept;
+
+    for (k = 0; k < b->n_slots; k++)
+    {
+        bucket = first + k;
+        slot = bucket % b->n_slots;
+        kept = 0;
+        for (i = 0; i < b->len[slot]; i++)
+            if ((long long)(loc_dist[b->v[slot][i]] / delta) == bucket)
+                b->v[slot][kept++] = b->v[slot][i];
+        b->len[slot] = kept;
+        if (kept > 0)
+            return bucket;
+    }
+    return LLONG_MAX;
+}
+
+/* Applies relaxation requests for local vertices, u = pred, w = new
+ * distance, and files improved vertices into their new bucket */
+void Relax_requests(Edge req[], idx_t n_req, Buckets *b, dist_t loc_dist[],
+                    idx_t loc_pred[], idx_t first, double delta)
+{
+    idx_t i, loc_v;
+
+    for (i = 0; i < n_req; i++)
+    {
+        loc_v = req[i].v - first;
+        if (req[i].w < loc_dist[loc_v])
+        {
+            loc_dist[loc_v] = req[i].w;
+            loc_pred[loc_v] = req[i].u;
+            Bucket_insert(b, (long long)(req[i].w / delta), loc_v);
+        }
+    }
+}
+
+void Delta_stepping(Loc_csr *out, double delta, idx_t src, dist_t loc_dist[],
+                    idx_t loc_pred[], idx_t loc_n, MPI_Comm comm, long long *phases_p,
+                    long long *rounds_p)
+{
+    Buckets b;
+    Edge *req, *recv_buf;
+    idx_t *frontier, *settled, loc_v, e, i, n_f, n_settled, n_req, max_req, n_recv;
+    idx_t first, slot, n_total, m_total;
+    char *in_frontier, *in_settled;
+    dist_t loc_max_w = 0, max_w;
+    long long cur, loc_next, phases = 0, rounds = 0;
+    int my_rank, more, loc_more, heavy;
+
+    MPI_Comm_rank(comm, &my_rank);
+    first = (idx_t)my_rank * loc_n;
+
+    for (e = 0; e < out->nnz; e++)
+        if (out->weight[e] > loc_max_w)
+            loc_max_w = out->weight[e];
+    MPI_Allreduce(&loc_max_w, &max_w, 1, MPI_DIST_T, MPI_MAX, comm);
+    if (delta <= 0)
+    {
+        /* max weight / average degree */
+        MPI_Allreduce(&out->nnz, &m_total, 1, MPI_IDX_T, MPI_SUM, comm);
+        MPI_Allreduce(&loc_n, &n_total, 1, MPI_IDX_T, MPI_SUM, comm);
+        delta = (m_total > 0) ? (double)max_w * n_total / m_total : 1;
+#ifndef DIST_FLOAT
+        delta = (delta < 1) ? 1 : (long long)delta;
+#endif
+        if (delta <= 0)
+            delta = 1;
+    }
+
+    b.n_slots = (long long)(max_w / delta) + 2;
+    b.v = calloc(b.n_slots, sizeof(idx_t *));
+    b.len = calloc(b.n_slots, sizeof(idx_t));
+    b.cap = calloc(b.n_slots, sizeof(idx_t));
+    frontier = malloc((loc_n + 1) * sizeof(idx_t));
+    settled = malloc((loc_n + 1) * sizeof(idx_t));
+    in_frontier = calloc(loc_n + 1, 1);
+    in_settled = calloc(loc_n + 1, 1);
+    max_req = 1024;
+    req = malloc(max_req * sizeof(Edge));
+
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        loc_dist[loc_v] = DIST_INF;
+        loc_pred[loc_v] = src;
+    }
+    if (src / loc_n == my_rank)
+    {
+        loc_dist[src % loc_n] = 0;
+        Bucket_insert(&b, 0, src % loc_n);
+    }
+
+    cur = 0;
+    for (;;)
+    {
+        loc_next = Next_bucket(&b, cur, loc_dist, delta);
+        MPI_Allreduce(&loc_next, &cur, 1, MPI_LONG_LONG, MPI_MIN, comm);
+        if (cur == LLONG_MAX)
+            break;
+        phases++;
+        slot = cur % b.n_slots;
+        n_settled = 0;
+
+        /* light rounds until bucket cur stays empty on every process,
+         * then one heavy round from all vertices settled in it */
+        for (heavy = 0; heavy <= 1; heavy++)
+        {
+            do
+            {
+                n_f = 0;
+                if (!heavy)
+                {
+                    for (i = 0; i < b.len[slot]; i++)
+                    {
+                        loc_v = b.v[slot][i];
+                        if (!in_frontier[loc_v] && (long long)(loc_dist[loc_v] / delta) == cur)
+                        {
+                            in_frontier[loc_v] = 1;
+                            frontier[n_f++] = loc_v;
+                        }
+                    }
+                    b.len[slot] = 0;
+                    for (i = 0; i < n_f; i++)
+                    {
+                        in_frontier[frontier[i]] = 0;
+                        if (!in_settled[frontier[i]])
+                        {
+                            in_settled[frontier[i]] = 1;
+                            settled[n_settled++] = frontier[i];
+                        }
+                    }
+                }
+
+                n_req = 0;
+                for (i = 0; i < (heavy ? n_settled : n_f); i++)
+                {
+                    loc_v = heavy ? settled[i] : frontier[i];
+                    for (e = out->row_ptr[loc_v]; e < out->row_ptr[loc_v + 1]; e++)
+                    {
+                        if ((out->weight[e] <= delta) == heavy)
+                            continue;
+                        if (n_req == max_req)
+                        {
+                            max_req *= 2;
+                            req = realloc(req, max_req * sizeof(Edge));
+                        }
+                        req[n_req].u = first + loc_v;
+                        req[n_req].v = out->col_idx[e];
+                        req[n_req].w = Sat_add(loc_dist[loc_v], out->weight[e]);
+                        n_req++;
+                    }
+                }
+                recv_buf = Route_edges(req, n_req, 0, loc_n, comm, &n_recv);
+                Relax_requests(recv_buf, n_recv, &b, loc_dist, loc_pred, first, delta);
+                free(recv_buf);
+                rounds++;
+
+                loc_more = 0;
+                if (!heavy)
+                    for (i = 0; i < b.len[slot] && !loc_more; i++)
+                        if ((long long)(loc_dist[b.v[slot][i]] / delta) == cur)
+                            loc_more = 1;
+                MPI_Allreduce(&loc_more, &more, 1, MPI_INT, MPI_LOR, comm);
+            } while (more);
+        }
+
+        for (i = 0; i < n_settled; i++)
+            in_settled[settled[i]] = 0;
+        cur++;
+    }
+
+    for (slot = 0; slot < b.n_slots; slot++)
+        free(b.v[slot]);
+    free(b.v);
+    free(b.len);
+    free(b.cap);
+    free(frontier);
+    free(settled);
+    free(in_frontier);
+    free(in_settled);
+    free(req);
+    *phases_p = phases;
+    *rounds_p = rounds;
+}
+
+void Dijkstra_csr_Init(Loc_csr *csr, idx_t src, idx_t loc_pred[], dist_t loc_dist[],
+                       int loc_known[], int my_rank, idx_t loc_n)
+{
+    idx_t loc_v, e;
 
-    Dijkstra_Init(loc_mat, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    {
+        loc_known[loc_v] = 0;
+        loc_dist[loc_v] = DIST_INF;
+        loc_pred[loc_v] = src;
+    }
+    if (src / loc_n == my_rank)
+    {
+        loc_known[src % loc_n] = 1;
+        loc_dist[src % loc_n] = 0;
+    }
+
+    /* edges leaving the source vertex */
+    for (e = csr->row_ptr[src]; e < csr->row_ptr[src + 1]; e++)
+        if (csr->weight[e] < loc_dist[csr->col_idx[e]])
+            loc_dist[csr->col_idx[e]] = csr->weight[e];
+}
+
+void Dijkstra_csr(Loc_csr *csr, idx_t src, dist_t loc_dist[], idx_t loc_pred[], idx_t loc_n,
+                  idx_t n, MPI_Comm comm)
+{
+    idx_t i, e, loc_v, loc_u, glbl_u;
+    dist_t new_dist, dist_glbl_u;
+    int my_rank;
+    int *loc_known;
+    Dist_loc my_min, glbl_min;
+    Loc_heap heap;
+
+    MPI_Comm_rank(comm, &my_rank);
+    loc_known = malloc(loc_n * sizeof(int));
+
+    Dijkstra_csr_Init(csr, src, loc_pred, loc_dist, loc_known, my_rank, loc_n);
+    Heap_init(&heap, loc_dist, loc_n);
+    for (loc_v = 0; loc_v < loc_n; loc_v++)
+        if (!loc_known[loc_v] && loc_dist[loc_v] < DIST_INF)
+            Heap_decrease(&heap, loc_v);
 
     for (i = 0; i < n - 1; i++)
     {
-        loc_u = Find_min_dist(loc_dist, loc_known, loc_n);
+        loc_u = (heap.size > 0) ? heap.heap[0] : -1;
 
         if (loc_u != -1)
         {
-            my_min[0] = loc_dist[loc_u];
-            my_min[1] = loc_u + my_rank * loc_n;
+            my_min.dist = loc_dist[loc_u];
+            my_min.v = loc_u + my_rank * loc_n;
         }
         else
         {
-            my_min[0] = INFINITY;
-            my_min[1] = -1;
+            my_min.dist = DIST_INF;
+            my_min.v = -1;
         }
 
-        start = MPI_Wtime();
-        MPI_Allreduce(my_min, glbl_min, 1, MPI_2INT, MPI_MINLOC, comm);
-        end = MPI_Wtime();
-        loc_u = glbl_min[1] % loc_n;
+        Min_loc_allreduce(&my_min, &glbl_min, comm);
 
-        glbl_u = glbl_min[1];
-        dist_glbl_u = glbl_min[0];
+        glbl_u = glbl_min.v;
+        dist_glbl_u = glbl_min.dist;
 
-        if (glbl_min[1] == -1)
+        if (glbl_u == -1)
             break;
 
-        loc_known[loc_u] = 1;
+        /* the winner was the top of its owner's heap */
+        if (glbl_u / loc_n == my_rank)
+            loc_known[Heap_pop(&heap)] = 1;
 
-        for (loc_v = 0; loc_v < loc_n; loc_v++)
+        /* only the existing edges glbl_u->v with v on this process */
+        for (e = csr->row_ptr[glbl_u]; e < csr->row_ptr[glbl_u + 1]; e++)
         {
+            loc_v = csr->col_idx[e];
             if (!loc_known[loc_v])
             {
-                new_dist = dist_glbl_u + loc_mat[glbl_u * loc_n + loc_v];
+                new_dist = Sat_add(dist_glbl_u, csr->weight[e]);
 
                 if (new_dist < loc_dist[loc_v])
                 {
                     loc_dist[loc_v] = new_dist;
                     loc_pred[loc_v] = glbl_u;
+                    Heap_decrease(&heap, loc_v);
                 }
             }
         }
     }
+    Heap_free(&heap);
     free(loc_known);
 }
 
-int Find_min_dist(int loc_dist[], int loc_known[], int loc_n)
+static inline int Heap_less(Loc_heap *h, idx_t a, idx_t b)
+{
+    return h->key[a] < h->key[b] || (h->key[a] == h->key[b] && a < b);
+}
+
+/* moves the vertex at index i up until its parent is not larger */
+static void Heap_sift_up(Loc_heap *h, idx_t i)
+{
+    idx_t v = h->heap[i], parent;
+
+    while (i > 0)
+    {
+        parent = (i - 1) / 4;
+        if (!Heap_less(h, v, h->heap[parent]))
+            break;
+        h->heap[i] = h->heap[parent];
+        h->pos[h->heap[i]] = i;
+        i = parent;
+    }
+    h->heap[i] = v;
+    h->pos[v] = i;
+}
+
+static void Heap_sift_down(Loc_heap *h, idx_t i)
+{
+    idx_t v = h->heap[i], child, c, best;
+
+    for (;;)
+    {
+        child = 4 * i + 1;
+        if (child >= h->size)
+            break;
+        best = child;
+        for (c = child + 1; c < child + 4 && c < h->size; c++)
+            if (Heap_less(h, h->heap[c], h->heap[best]))
+                best = c;
+        if (!Heap_less(h, h->heap[best], v))
+            break;
+        h->heap[i] = h->heap[best];
+        h->pos[h->heap[i]] = i;
+        i = best;
+    }
+    h->heap[i] = v;
+    h->pos[v] = i;
+}
+
+void Heap_init(Loc_heap *h, dist_t loc_dist[], idx_t loc_n)
+{
+    idx_t v;
+
+    h->heap = malloc((loc_n + 1) * sizeof(idx_t));
+    h->pos = malloc((loc_n + 1) * sizeof(idx_t));
+    h->key = loc_dist;
+    h->size = 0;
+    for (v = 0; v < loc_n; v++)
+        h->pos[v] = -1;
+}
+
+void Heap_free(Loc_heap *h)
+{
+    free(h->heap);
+    free(h->pos);
+}
+
+/* call after lowering key[v]; inserts v if it is not in the heap */
+void Heap_decrease(Loc_heap *h, idx_t v)
+{
+    if (h->pos[v] < 0)
+    {
+        h->heap[h->size] = v;
+        h->pos[v] = h->size++;
+    }
+    Heap_sift_up(h, h->pos[v]);
+}
+
+idx_t Heap_pop(Loc_heap *h)
 {
-    int loc_u, loc_v;
-    int shortest_dist = INFINITY;
+    idx_t top = h->heap[0];
+
+    h->pos[top] = -1;
+    h->size--;
+    if (h->size > 0)
+    {
+        h->heap[0] = h->heap[h->size];
+        Heap_sift_down(h, 0);
+    }
+    return top;
+}
+
+/* Local unknown vertex with the smallest distance (the first one on
+ * ties), -1 if there is none below DIST_INF.  The vector versions keep
+ * one running minimum per lane and merge the lanes at the end */
+idx_t Find_min_dist(dist_t loc_dist[], int loc_known[], idx_t loc_n)
+{
+    idx_t loc_u, loc_v = 0;
+    dist_t shortest_dist = DIST_INF, key;
     loc_u = -1;
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+    int lane_min[16], lane_idx[16], lanes;
+#endif
+#if defined(SIMD_AVX512)
+    __m512i minv = _mm512_set1_epi32(DIST_INF), mini = _mm512_set1_epi32(-1);
+    __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i step = _mm512_set1_epi32(16), d;
+    __mmask16 unknown, less;
 
-    for (loc_v = 0; loc_v < loc_n; loc_v++)
+    lanes = 16;
+    for (; loc_v + 16 <= loc_n; loc_v += 16)
+    {
+        d = _mm512_loadu_si512(&loc_dist[loc_v]);
+        unknown = _mm512_testn_epi32_mask(_mm512_loadu_si512(&loc_known[loc_v]),
+                                          _mm512_set1_epi32(-1));
+        less = _mm512_mask_cmplt_epi32_mask(unknown, d, minv);
+        minv = _mm512_mask_mov_epi32(minv, less, d);
+        mini = _mm512_mask_mov_epi32(mini, less, idx);
+        idx = _mm512_add_epi32(idx, step);
+    }
+    _mm512_storeu_si512(lane_min, minv);
+    _mm512_storeu_si512(lane_idx, mini);
+#elif defined(SIMD_AVX2)
+    __m256i minv = _mm256_set1_epi32(DIST_INF), mini = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i step = _mm256_set1_epi32(8), inf = minv, keyv, less;
+
+    lanes = 8;
+    for (; loc_v + 8 <= loc_n; loc_v += 8)
+    {
+        keyv = _mm256_blendv_epi8(_mm256_loadu_si256((__m256i *)&loc_dist[loc_v]), inf,
+                                  _mm256_loadu_si256((__m256i *)&loc_known[loc_v]));
+        less = _mm256_cmpgt_epi32(minv, keyv);
+        minv = _mm256_blendv_epi8(minv, keyv, less);
+        mini = _mm256_blendv_epi8(mini, idx, less);
+        idx = _mm256_add_epi32(idx, step);
+    }
+    _mm256_storeu_si256((__m256i *)lane_min, minv);
+    _mm256_storeu_si256((__m256i *)lane_idx, mini);
+#endif
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+    Merge_lanes(lane_min, lane_idx, lanes, &shortest_dist, &loc_u);
+#endif
+
+    for (; loc_v < loc_n; loc_v++)
     {
-        if (!loc_known[loc_v])
+        key = loc_known[loc_v] ? DIST_INF : loc_dist[loc_v];
+        if (key < shortest_dist)
         {
-            if (loc_dist[loc_v] < shortest_dist)
-            {
-                shortest_dist = loc_dist[loc_v];
-                loc_u = loc_v;
-            }
+            shortest_dist = key;
+            loc_u = loc_v;
         }
     }
 
     return loc_u;
 }
 
-void Print_matrix(int global_mat[], int rows, int cols)
+void Print_matrix(dist_t global_mat[], idx_t rows, idx_t cols)
 {
-    int i, j;
+    idx_t i, j;
 
     for (i = 0; i < rows; i++)
     {
         for (j = 0; j < cols; j++)
-            printf("%d ", global_mat[i * cols + j]);
+            printf(DIST_FMT " ", global_mat[(size_t)i * cols + j]);
         printf("\n");
     }
 }
 
-void Print_dists(int global_dist[], int n, FILE *output_file)
+void Print_dists(dist_t global_dist[], idx_t src, idx_t n, FILE *output_file)
 {
-    int v;
-    fprintf(output_file, "    v     dist 0->v\n");
+    idx_t v;
+    fprintf(output_file, "    v     dist " IDX_FMT "->v\n", src);
     fprintf(output_file, "  ----    ---------\n");
-    for (v = 1; v < n; v++)
-        fprintf(output_file, "    %d        %d\n", v, global_dist[v]);
+    for (v = 0; v < n; v++)
+        if (v == src)
+            continue;
+        else if (global_dist[v] == DIST_INF)
+            fprintf(output_file, "    " IDX_FMT "        inf\n", v);
+        else
+            fprintf(output_file, "    " IDX_FMT "        " DIST_FMT "\n", v, global_dist[v]);
     fprintf(output_file, "\n");
 }
 
-void Print_paths(int global_pred[], int n, FILE *output_file)
+void Print_paths(idx_t global_pred[], idx_t src, idx_t n, FILE *output_file)
 {
-    int v, w, *path, count, i;
+    idx_t v, w, *path, count, i;
 
-    path = malloc(n * sizeof(int));
-    printf("  v     Path 0->v\n");
-    printf("----    ---------\n");
-    fprintf(output_file, "    v     Path 0->v\n");
+    path = malloc(n * sizeof(idx_t));
+    fprintf(output_file, "    v     Path " IDX_FMT "->v\n", src);
     fprintf(output_file, "  ----    ---------\n");
-    for (v = 1; v < n; v++)
+    for (v = 0; v < n; v++)
     {
-        printf("%3d:    ", v);
-        fprintf(output_file, "    %d:    ", v);
+        if (v == src)
+            continue;
+        fprintf(output_file, "    " IDX_FMT ":    ", v);
         count = 0;
         w = v;
-        while (w != 0)
+        while (w != src)
         {
             path[count] = w;
             count++;
             w = global_pred[w];
         }
-        printf("0 ");
-        fprintf(output_file, "0 ");
-        for (i = count - 1; i >= 0; i--){
-            fprintf(output_file, "%d ", path[i]);
-            printf("%d ", path[i]);
-        }
+        fprintf(output_file, IDX_FMT " ", src);
+        for (i = count - 1; i >= 0; i--)
+            fprintf(output_file, IDX_FMT " ", path[i]);
         fprintf(output_file, "\n");
-        printf("\n");
     }
     free(path);
     fprintf(output_file, "\n");
-}
\ No newline at end of file
+}
+
+/* -paths / -paths-bin, 0 if path can't be written */
+int Open_path_file(Path_file *pf, char *path, int binary, idx_t n, MPI_Comm comm)
+{
+    char header[PATH_HEADER_SIZE];
+    int my_rank, elem_size = sizeof(idx_t);
+    long long ll_n = n;
+
+    MPI_Comm_rank(comm, &my_rank);
+    if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &pf->fh) !=
+        MPI_SUCCESS)
+    {
+        if (my_rank == 0)
+            fprintf(stderr, "Can't write the paths to %s\n", path);
+        return 0;
+    }
+    MPI_File_set_size(pf->fh, 0);
+    pf->binary = binary;
+    pf->off = 0;
+    if (binary)
+    {
+        if (my_rank == 0)
+        {
+            memcpy(header, PATH_MAGIC, 4);
+            memcpy(header + 4, &elem_size, sizeof(int));
+            memcpy(header + 8, &ll_n, sizeof(long long));
+            MPI_File_write_at(pf->fh, 0, header, PATH_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        pf->off = PATH_HEADER_SIZE;
+    }
+    pf->buf = malloc(PATH_BUF);
+    pf->len = 0;
+    return 1;
+}
+
+static void Path_flush(Path_file *pf)
+{
+    if (pf->len > 0)
+        MPI_File_write_at(pf->fh, pf->buf_off, pf->buf, (int)pf->len, MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+    pf->buf_off += pf->len;
+    pf->len = 0;
+}
+
+static void Path_put(Path_file *pf, const void *data, size_t size)
+{
+    if (pf->len + size > PATH_BUF)
+        Path_flush(pf);
+    memcpy(pf->buf + pf->len, data, size);
+    pf->len += size;
+}
+
+static int Idx_width(idx_t v)
+{
+    char s[32];
+
+    return snprintf(s, sizeof(s), IDX_FMT, v);
+}
+
+/* len[v] for v and its ancestors that don't have it yet: the bytes of
+ * "src .. v " in text, the number of vertices src .. v in binary */
+static void Path_len(idx_t pred[], long long len[], idx_t stack[], idx_t v, int binary)
+{
+    idx_t top = 0, w;
+
+    for (w = v; len[w] < 0; w = pred[w])
+        stack[top++] = w;
+    while (top > 0)
+    {
+        w = stack[--top];
+        len[w] = len[pred[w]] + (binary ? 1 : Idx_width(w) + 1);
+    }
+}
+
+/* The paths from src, see Paths in the header.  global_pred is only
+ * read on process 0 */
+void Write_paths_par(idx_t global_pred[], idx_t src, idx_t n, Path_file *pf, MPI_Comm comm)
+{
+    idx_t *pred, *stack, chunk, first, last, v, w, top;
+    long long *len, mine = 0, before = 0, total = 0, *counts, off;
+    char head[128], line[32];
+    int my_rank, p, q, head_len, k;
+
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_size(comm, &p);
+    pred = (my_rank == 0) ? global_pred : malloc(n * sizeof(idx_t));
+    MPI_Bcast(pred, n, MPI_IDX_T, 0, comm);
+
+    chunk = (n + p - 1) / p;
+    first = (my_rank * chunk < n) ? my_rank * chunk : n;
+    last = (first + chunk < n) ? first + chunk : n;
+    len = malloc(n * sizeof(long long));
+    stack = malloc(n * sizeof(idx_t));
+    for (v = 0; v < n; v++)
+        len[v] = -1;
+    len[src] = pf->binary ? 1 : Idx_width(src) + 1;
+    for (v = first; v < last; v++)
+    {
+        Path_len(pred, len, stack, v, pf->binary);
+        if (pf->binary)
+            mine += len[v];
+        else if (v != src)
+            mine += Idx_width(v) + 10 + len[v];
+    }
+
+    counts = malloc(p * sizeof(long long));
+    MPI_Allgather(&mine, 1, MPI_LONG_LONG, counts, 1, MPI_LONG_LONG, comm);
+    for (q = 0; q < p; q++)
+    {
+        if (q < my_rank)
+            before += counts[q];
+        total += counts[q];
+    }
+
+    if (pf->binary)
+    {
+        /* src, the n + 1 offsets and then the vertex numbers */
+        if (my_rank == 0)
+        {
+            off = src;
+            MPI_File_write_at(pf->fh, pf->off, &off, 1, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+        }
+        pf->buf_off = pf->off + (1 + first) * (MPI_Offset)sizeof(long long);
+        off = before;
+        for (v = first; v < last; v++)
+        {
+            Path_put(pf, &off, sizeof(long long));
+            off += len[v];
+        }
+        if (my_rank == p - 1)
+            Path_put(pf, &total, sizeof(long long));
+        Path_flush(pf);
+        pf->buf_off = pf->off + (n + 2) * (MPI_Offset)sizeof(long long) +
+                      before * (MPI_Offset)sizeof(idx_t);
+        head_len = 0;
+        total = (n + 2) * sizeof(long long) + total * sizeof(idx_t);
+    }
+    else
+    {
+        head_len = snprintf(head, sizeof(head),
+                            "    v     Path " IDX_FMT "->v\n  ----    ---------\n", src);
+        if (my_rank == 0)
+            MPI_File_write_at(pf->fh, pf->off, head, head_len, MPI_BYTE, MPI_STATUS_IGNORE);
+        if (my_rank == p - 1)
+            MPI_File_write_at(pf->fh, pf->off + head_len + total, "\n", 1, MPI_BYTE,
+                              MPI_STATUS_IGNORE);
+        pf->buf_off = pf->off + head_len + before;
+        total++;
+    }
+
+    for (v = first; v < last; v++)
+    {
+        if (v == src && !pf->binary)
+            continue;
+        if (!pf->binary)
+        {
+            k = snprintf(line, sizeof(line), "    " IDX_FMT ":    ", v);
+            Path_put(pf, line, k);
+        }
+        top = 0;
+        for (w = v; w != src; w = pred[w])
+            stack[top++] = w;
+        stack[top++] = src;
+        while (top > 0)
+            if (pf->binary)
+                Path_put(pf, &stack[--top], sizeof(idx_t));
+            else
+            {
+                k = snprintf(line, sizeof(line), IDX_FMT " ", stack[--top]);
+                Path_put(pf, line, k);
+            }
+        if (!pf->binary)
+            Path_put(pf, "\n", 1);
+    }
+    Path_flush(pf);
+    pf->off += head_len + total;
+
+    if (my_rank != 0)
+        free(pred);
+    free(len);
+    free(stack);
+    free(counts);
+}
+
+void Close_path_file(Path_file *pf)
+{
+    MPI_File_close(&pf->fh);
+    free(pf->buf);
+}
@@ -1,4 +1,6 @@
 import random
+import struct
+from array import array
 
 def generate_matrix(size):
   """Tạo ma trận ngẫu nhiên và lưu vào file txt.
@@ -25,9 +27,15 @@ def generate_matrix(size):
     for row in matrix:
       f.write(" ".join(str(x) for x in row) + "\n")
 
+  # ban nhi phan cho dijsktra -bin: "DJKM", kich thuoc phan tu, n, roi n*n so int32
+  with open("matrix.bin", "wb") as f:
+    f.write(b"DJKM" + struct.pack("<iq", 4, size))
+    for row in matrix:
+      array("i", row).tofile(f)
+
 #nhap kich thuoc ma tran
 size = int(input("Nhập kích thước ma trận: "))
 
 # tao ma tran va luu vao file
 generate_matrix(size)
-print(f"Đã tạo ma trận kích thước {size}x{size} vào file 'matrix.txt'")
\ No newline at end of file
+print(f"Đã tạo ma trận kích thước {size}x{size} vào file 'matrix.txt' và 'matrix.bin'")
\ No newline at end of file
@@ -0,0 +1,359 @@
+/* File:     minplus.h
+ *
+ * Purpose:  Min-plus (tropical semiring) matrix products for dense
+ *           distance blocks:
+ *
+ *               C = min(C, A (x) B),  C[i][j] = min(C[i][j], min_k A[i][k] + B[k][j])
+ *
+ *           for row-major A (m x k), B (k x n) and C (m x n) with leading
+ *           dimensions lda, ldb and ldc, over int32 and float.
+ *
+ * Infinity: INT32_MAX for int32 (sums are saturated, so INT32_MAX + w
+ *           stays INT32_MAX) and FLT_MAX for float (FLT_MAX + w rounds
+ *           back to FLT_MAX, FLT_MAX + FLT_MAX is +inf and never below
+ *           an entry of C).  Entries must not be negative.
+ *
+ * Blocking: as in a GEMM.  B is packed KC rows x NC columns at a time
+ *           into column panels NR wide, and A into row panels MR high,
+ *           both padded with infinity.  The micro kernel keeps an MR x NR
+ *           tile of C in registers for the whole KC loop and reads the
+ *           packed panels sequentially.  MR x NR is 8 x 32 with AVX-512,
+ *           4 x 16 with AVX2 and 4 x 8 otherwise.  With OpenMP the tiles
+ *           of C are shared among the threads.
+ *
+ * Aliasing: C may share storage with A or B.  Every KC block is packed
+ *           before C is written, so each product uses entries of A and B
+ *           that are at most as large as on entry, which is what blocked
+ *           Floyd-Warshall needs.
+ *
+ * Use:      #include "minplus.h" (the functions are static, no extra
+ *           object to link), compile with -march=native or -mavx2 /
+ *           -mavx512f for the SIMD kernels and -fopenmp for threads.
+ *           minplus_bench.c measures them against the triple loop.
+ */
+#ifndef MINPLUS_H
+#define MINPLUS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#define MINPLUS_INF_I32 INT32_MAX
+#define MINPLUS_INF_F32 FLT_MAX
+
+#if defined(__AVX512F__)
+#define MINPLUS_MR 8
+#define MINPLUS_NR 32
+#elif defined(__AVX2__)
+#define MINPLUS_MR 4
+#define MINPLUS_NR 16
+#else
+#define MINPLUS_MR 4
+#define MINPLUS_NR 8
+#endif
+#ifdef _OPENMP
+#define MINPLUS_OMP(x) _Pragma(x)
+#else
+#define MINPLUS_OMP(x)
+#endif
+#define MINPLUS_KC 256
+#define MINPLUS_NC 2048
+
+/* ap[p][kk][r] = a[p * MR + r][kk] for the row panels p of an m x kc
+ * block, rows past m are infinity */
+#define MINPLUS_PACK_A(T, INF, a, lda, ap, m, kc)                               \
+    do {                                                                        \
+        long p_, kk_, r_, i_, n_panels_ = ((m) + MINPLUS_MR - 1) / MINPLUS_MR;  \
+        MINPLUS_OMP("omp parallel for private(kk_, r_, i_)")                        \
+        for (p_ = 0; p_ < n_panels_; p_++)                                      \
+            for (kk_ = 0; kk_ < (long)(kc); kk_++)                              \
+                for (r_ = 0; r_ < MINPLUS_MR; r_++)                             \
+                {                                                               \
+                    i_ = p_ * MINPLUS_MR + r_;                                  \
+                    (ap)[((size_t)p_ * (kc) + kk_) * MINPLUS_MR + r_] =         \
+                        (i_ < (long)(m)) ? (a)[(size_t)i_ * (lda) + kk_] : (INF); \
+                }                                                               \
+    } while (0)
+
+/* bp[p][kk][c] = b[kk][p * NR + c] for the column panels p of a kc x nc
+ * block, columns past nc are infinity */
+#define MINPLUS_PACK_B(T, INF, b, ldb, bp, kc, nc)                              \
+    do {                                                                        \
+        long p_, kk_, c_, j_, n_panels_ = ((nc) + MINPLUS_NR - 1) / MINPLUS_NR; \
+        MINPLUS_OMP("omp parallel for private(kk_, c_, j_)")                        \
+        for (p_ = 0; p_ < n_panels_; p_++)                                      \
+            for (kk_ = 0; kk_ < (long)(kc); kk_++)                              \
+                for (c_ = 0; c_ < MINPLUS_NR; c_++)                             \
+                {                                                               \
+                    j_ = p_ * MINPLUS_NR + c_;                                  \
+                    (bp)[((size_t)p_ * (kc) + kk_) * MINPLUS_NR + c_] =         \
+                        (j_ < (long)(nc)) ? (b)[(size_t)kk_ * (ldb) + j_] : (INF); \
+                }                                                               \
+    } while (0)
+
+/* MR x NR tile c (leading dimension ldc) = min(c, ap (x) bp) over kc */
+static inline void Minplus_kernel_i32(long kc, const int32_t *ap, const int32_t *bp, int32_t *c,
+                               size_t ldc)
+{
+    long kk;
+    int r;
+#if defined(__AVX512F__)
+    __m512i acc[MINPLUS_MR][2], b0, b1, xv, limv, inf = _mm512_set1_epi32(MINPLUS_INF_I32);
+
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        acc[r][0] = _mm512_loadu_si512(&c[r * ldc]);
+        acc[r][1] = _mm512_loadu_si512(&c[r * ldc + 16]);
+    }
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+    {
+        b0 = _mm512_loadu_si512(bp);
+        b1 = _mm512_loadu_si512(bp + 16);
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            xv = _mm512_set1_epi32(ap[r]);
+            limv = _mm512_sub_epi32(inf, xv);
+            acc[r][0] = _mm512_min_epi32(acc[r][0], _mm512_add_epi32(xv, _mm512_min_epi32(b0, limv)));
+            acc[r][1] = _mm512_min_epi32(acc[r][1], _mm512_add_epi32(xv, _mm512_min_epi32(b1, limv)));
+        }
+    }
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        _mm512_storeu_si512(&c[r * ldc], acc[r][0]);
+        _mm512_storeu_si512(&c[r * ldc + 16], acc[r][1]);
+    }
+#elif defined(__AVX2__)
+    __m256i acc[MINPLUS_MR][2], b0, b1, xv, limv, inf = _mm256_set1_epi32(MINPLUS_INF_I32);
+
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        acc[r][0] = _mm256_loadu_si256((__m256i *)&c[r * ldc]);
+        acc[r][1] = _mm256_loadu_si256((__m256i *)&c[r * ldc + 8]);
+    }
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+    {
+        b0 = _mm256_loadu_si256((__m256i *)bp);
+        b1 = _mm256_loadu_si256((__m256i *)(bp + 8));
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            xv = _mm256_set1_epi32(ap[r]);
+            limv = _mm256_sub_epi32(inf, xv);
+            acc[r][0] = _mm256_min_epi32(acc[r][0], _mm256_add_epi32(xv, _mm256_min_epi32(b0, limv)));
+            acc[r][1] = _mm256_min_epi32(acc[r][1], _mm256_add_epi32(xv, _mm256_min_epi32(b1, limv)));
+        }
+    }
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        _mm256_storeu_si256((__m256i *)&c[r * ldc], acc[r][0]);
+        _mm256_storeu_si256((__m256i *)&c[r * ldc + 8], acc[r][1]);
+    }
+#else
+    int32_t acc[MINPLUS_MR][MINPLUS_NR], x, cand;
+    int j;
+
+    for (r = 0; r < MINPLUS_MR; r++)
+        memcpy(acc[r], &c[r * ldc], sizeof(acc[r]));
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            x = ap[r];
+            for (j = 0; j < MINPLUS_NR; j++)
+            {
+                cand = (bp[j] > MINPLUS_INF_I32 - x) ? MINPLUS_INF_I32 : x + bp[j];
+                acc[r][j] = (cand < acc[r][j]) ? cand : acc[r][j];
+            }
+        }
+    for (r = 0; r < MINPLUS_MR; r++)
+        memcpy(&c[r * ldc], acc[r], sizeof(acc[r]));
+#endif
+}
+
+static inline void Minplus_kernel_f32(long kc, const float *ap, const float *bp, float *c, size_t ldc)
+{
+    long kk;
+    int r;
+#if defined(__AVX512F__)
+    __m512 acc[MINPLUS_MR][2], b0, b1, xv;
+
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        acc[r][0] = _mm512_loadu_ps(&c[r * ldc]);
+        acc[r][1] = _mm512_loadu_ps(&c[r * ldc + 16]);
+    }
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+    {
+        b0 = _mm512_loadu_ps(bp);
+        b1 = _mm512_loadu_ps(bp + 16);
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            xv = _mm512_set1_ps(ap[r]);
+            acc[r][0] = _mm512_min_ps(acc[r][0], _mm512_add_ps(xv, b0));
+            acc[r][1] = _mm512_min_ps(acc[r][1], _mm512_add_ps(xv, b1));
+        }
+    }
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        _mm512_storeu_ps(&c[r * ldc], acc[r][0]);
+        _mm512_storeu_ps(&c[r * ldc + 16], acc[r][1]);
+    }
+#elif defined(__AVX2__)
+    __m256 acc[MINPLUS_MR][2], b0, b1, xv;
+
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        acc[r][0] = _mm256_loadu_ps(&c[r * ldc]);
+        acc[r][1] = _mm256_loadu_ps(&c[r * ldc + 8]);
+    }
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+    {
+        b0 = _mm256_loadu_ps(bp);
+        b1 = _mm256_loadu_ps(bp + 8);
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            xv = _mm256_set1_ps(ap[r]);
+            acc[r][0] = _mm256_min_ps(acc[r][0], _mm256_add_ps(xv, b0));
+            acc[r][1] = _mm256_min_ps(acc[r][1], _mm256_add_ps(xv, b1));
+        }
+    }
+    for (r = 0; r < MINPLUS_MR; r++)
+    {
+        _mm256_storeu_ps(&c[r * ldc], acc[r][0]);
+        _mm256_storeu_ps(&c[r * ldc + 8], acc[r][1]);
+    }
+#else
+    float acc[MINPLUS_MR][MINPLUS_NR], x, cand;
+    int j;
+
+    for (r = 0; r < MINPLUS_MR; r++)
+        memcpy(acc[r], &c[r * ldc], sizeof(acc[r]));
+    for (kk = 0; kk < kc; kk++, ap += MINPLUS_MR, bp += MINPLUS_NR)
+        for (r = 0; r < MINPLUS_MR; r++)
+        {
+            x = ap[r];
+            for (j = 0; j < MINPLUS_NR; j++)
+            {
+                cand = x + bp[j];
+                acc[r][j] = (cand < acc[r][j]) ? cand : acc[r][j];
+            }
+        }
+    for (r = 0; r < MINPLUS_MR; r++)
+        memcpy(&c[r * ldc], acc[r], sizeof(acc[r]));
+#endif
+}
+
+/* Runs the kernel over every MR x NR tile of the m x nc block c.  Tiles
+ * that stick out of c go through an infinity-padded copy */
+#define MINPLUS_TILES(T, INF, KERNEL, ap, bp, c, ldc, m, nc, kc)                \
+    do {                                                                        \
+        long ir_, jr_, r_, mr_, nr_;                                            \
+        long m_panels_ = ((m) + MINPLUS_MR - 1) / MINPLUS_MR;                   \
+        long n_panels_ = ((nc) + MINPLUS_NR - 1) / MINPLUS_NR;                  \
+        T edge_[MINPLUS_MR * MINPLUS_NR];                                       \
+        MINPLUS_OMP("omp parallel for collapse(2) private(r_, mr_, nr_, edge_)")    \
+        for (ir_ = 0; ir_ < m_panels_; ir_++)                                   \
+            for (jr_ = 0; jr_ < n_panels_; jr_++)                               \
+            {                                                                   \
+                T *ct_ = &(c)[(size_t)ir_ * MINPLUS_MR * (ldc) + jr_ * MINPLUS_NR]; \
+                mr_ = (long)(m) - ir_ * MINPLUS_MR;                             \
+                nr_ = (long)(nc) - jr_ * MINPLUS_NR;                            \
+                if (mr_ >= MINPLUS_MR && nr_ >= MINPLUS_NR)                     \
+                {                                                               \
+                    KERNEL(kc, &(ap)[(size_t)ir_ * (kc) * MINPLUS_MR],          \
+                           &(bp)[(size_t)jr_ * (kc) * MINPLUS_NR], ct_, (ldc)); \
+                    continue;                                                   \
+                }                                                               \
+                if (mr_ > MINPLUS_MR)                                           \
+                    mr_ = MINPLUS_MR;                                           \
+                if (nr_ > MINPLUS_NR)                                           \
+                    nr_ = MINPLUS_NR;                                           \
+                for (r_ = 0; r_ < MINPLUS_MR * MINPLUS_NR; r_++)                \
+                    edge_[r_] = (INF);                                          \
+                for (r_ = 0; r_ < mr_; r_++)                                    \
+                    memcpy(&edge_[r_ * MINPLUS_NR], &ct_[r_ * (ldc)], nr_ * sizeof(T)); \
+                KERNEL(kc, &(ap)[(size_t)ir_ * (kc) * MINPLUS_MR],              \
+                       &(bp)[(size_t)jr_ * (kc) * MINPLUS_NR], edge_, MINPLUS_NR); \
+                for (r_ = 0; r_ < mr_; r_++)                                    \
+                    memcpy(&ct_[r_ * (ldc)], &edge_[r_ * MINPLUS_NR], nr_ * sizeof(T)); \
+            }                                                                   \
+    } while (0)
+
+/* The GEMM loop nest: NC columns of C at a time, KC terms of the
+ * products at a time, see Blocking above */
+#define MINPLUS_GEMM(T, INF, KERNEL, m, n, k, a, lda, b, ldb, c, ldc)           \
+    do {                                                                        \
+        size_t jc_, pc_, nc_, kc_;                                              \
+        size_t m_pad_ = ((m) + MINPLUS_MR - 1) / MINPLUS_MR * MINPLUS_MR;       \
+        T *ap_, *bp_;                                                           \
+        if ((m) == 0 || (n) == 0 || (k) == 0)                                   \
+            break;                                                              \
+        ap_ = malloc(m_pad_ * MINPLUS_KC * sizeof(T));                          \
+        bp_ = malloc((size_t)(MINPLUS_NC + MINPLUS_NR) * MINPLUS_KC * sizeof(T)); \
+        for (jc_ = 0; jc_ < (n); jc_ += MINPLUS_NC)                             \
+        {                                                                       \
+            nc_ = ((n) - jc_ < MINPLUS_NC) ? (n) - jc_ : MINPLUS_NC;            \
+            for (pc_ = 0; pc_ < (k); pc_ += MINPLUS_KC)                         \
+            {                                                                   \
+                kc_ = ((k) - pc_ < MINPLUS_KC) ? (k) - pc_ : MINPLUS_KC;        \
+                MINPLUS_PACK_B(T, INF, &(b)[pc_ * (ldb) + jc_], ldb, bp_, kc_, nc_); \
+                MINPLUS_PACK_A(T, INF, &(a)[pc_], lda, ap_, m, kc_);            \
+                MINPLUS_TILES(T, INF, KERNEL, ap_, bp_, &(c)[jc_], ldc, m, nc_, (long)kc_); \
+            }                                                                   \
+        }                                                                       \
+        free(ap_);                                                              \
+        free(bp_);                                                              \
+    } while (0)
+
+/* c = min(c, a (x) b) for int32, see the header */
+static inline void Minplus_gemm_i32(size_t m, size_t n, size_t k, const int32_t *a, size_t lda,
+                             const int32_t *b, size_t ldb, int32_t *c, size_t ldc)
+{
+    MINPLUS_GEMM(int32_t, MINPLUS_INF_I32, Minplus_kernel_i32, m, n, k, a, lda, b, ldb, c, ldc);
+}
+
+/* c = min(c, a (x) b) for float, see the header */
+static inline void Minplus_gemm_f32(size_t m, size_t n, size_t k, const float *a, size_t lda,
+                             const float *b, size_t ldb, float *c, size_t ldc)
+{
+    MINPLUS_GEMM(float, MINPLUS_INF_F32, Minplus_kernel_f32, m, n, k, a, lda, b, ldb, c, ldc);
+}
+
+/* Reference triple loop, c = min(c, a (x) b) for int32 */
+static inline void Minplus_naive_i32(size_t m, size_t n, size_t k, const int32_t *a, size_t lda,
+                              const int32_t *b, size_t ldb, int32_t *c, size_t ldc)
+{
+    size_t i, j, kk;
+    int32_t cand;
+
+    for (i = 0; i < m; i++)
+        for (j = 0; j < n; j++)
+            for (kk = 0; kk < k; kk++)
+            {
+                cand = (b[kk * ldb + j] > MINPLUS_INF_I32 - a[i * lda + kk])
+                           ? MINPLUS_INF_I32 : a[i * lda + kk] + b[kk * ldb + j];
+                if (cand < c[i * ldc + j])
+                    c[i * ldc + j] = cand;
+            }
+}
+
+/* Reference triple loop, c = min(c, a (x) b) for float */
+static inline void Minplus_naive_f32(size_t m, size_t n, size_t k, const float *a, size_t lda,
+                              const float *b, size_t ldb, float *c, size_t ldc)
+{
+    size_t i, j, kk;
+    float cand;
+
+    for (i = 0; i < m; i++)
+        for (j = 0; j < n; j++)
+            for (kk = 0; kk < k; kk++)
+            {
+                cand = a[i * lda + kk] + b[kk * ldb + j];
+                if (cand < c[i * ldc + j])
+                    c[i * ldc + j] = cand;
+            }
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*----------------------------------------------------
+ * File:    minplus_bench.c
+ *
+ * Purpose: measure the min-plus products of minplus.h against the
+ *          naive triple loop and check that both give the same C
+ *
+ * Compile: gcc -O2 -march=native -fopenmp -o minplus_bench minplus_bench.c
+ * Run:     ./minplus_bench [n] [reps] [density]
+ *
+ * Input:   n: size of the square matrices (default 1024)
+ *          reps: timed runs of the blocked product, the best is kept
+ *                (default 3)
+ *          density: fraction of finite entries (default 0.5)
+ *
+ * Output:  time and GOP/s (one add and one min per term, 2 n^3
+ *          operations) of the naive loop and the blocked product for
+ *          int32 and float, and the speedup
+ *--------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "minplus.h"
+
+double Now(void);
+void Fill_i32(int32_t x[], size_t len, double density);
+void Bench_i32(size_t n, int reps, double density);
+void Bench_f32(size_t n, int reps, double density);
+
+int main(int argc, char *argv[])
+{
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1024;
+    int reps = (argc > 2) ? atoi(argv[2]) : 3;
+    double density = (argc > 3) ? atof(argv[3]) : 0.5;
+    int threads = 1;
+
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    printf("n = %zu, %d threads, tile %d x %d, KC %d, NC %d\n", n, threads, MINPLUS_MR,
+           MINPLUS_NR, MINPLUS_KC, MINPLUS_NC);
+    srand(1);
+    Bench_i32(n, reps, density);
+    Bench_f32(n, reps, density);
+    return 0;
+}
+
+double Now(void)
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Weights 1..100, infinity with probability 1 - density */
+void Fill_i32(int32_t x[], size_t len, double density)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        x[i] = (rand() < density * RAND_MAX) ? 1 + rand() % 100 : MINPLUS_INF_I32;
+}
+
+void Bench_i32(size_t n, int reps, double density)
+{
+    int32_t *a = malloc(n * n * sizeof(int32_t));
+    int32_t *b = malloc(n * n * sizeof(int32_t));
+    int32_t *c0 = malloc(n * n * sizeof(int32_t));
+    int32_t *c_naive = malloc(n * n * sizeof(int32_t));
+    int32_t *c = malloc(n * n * sizeof(int32_t));
+    double t, t_naive, t_best = 0, ops = 2.0 * n * n * n;
+    size_t i, bad = 0;
+    int r;
+
+    Fill_i32(a, n * n, density);
+    Fill_i32(b, n * n, density);
+    Fill_i32(c0, n * n, density);
+
+    memcpy(c_naive, c0, n * n * sizeof(int32_t));
+    t = Now();
+    Minplus_naive_i32(n, n, n, a, n, b, n, c_naive, n);
+    t_naive = Now() - t;
+
+    for (r = 0; r < reps; r++)
+    {
+        memcpy(c, c0, n * n * sizeof(int32_t));
+        t = Now();
+        Minplus_gemm_i32(n, n, n, a, n, b, n, c, n);
+        t = Now() - t;
+        if (r == 0 || t < t_best)
+            t_best = t;
+    }
+    for (i = 0; i < n * n; i++)
+        bad += (c[i] != c_naive[i]);
+
+    printf("int32: naive %.3f s %.2f GOP/s, blocked %.3f s %.2f GOP/s, speedup %.1f, %s\n",
+           t_naive, ops / t_naive * 1e-9, t_best, ops / t_best * 1e-9, t_naive / t_best,
+           bad ? "MISMATCH" : "ok");
+    free(a);
+    free(b);
+    free(c0);
+    free(c_naive);
+    free(c);
+}
+
+void Bench_f32(size_t n, int reps, double density)
+{
+    int32_t *w = malloc(n * n * sizeof(int32_t));
+    float *a = malloc(n * n * sizeof(float));
+    float *b = malloc(n * n * sizeof(float));
+    float *c0 = malloc(n * n * sizeof(float));
+    float *c_naive = malloc(n * n * sizeof(float));
+    float *c = malloc(n * n * sizeof(float));
+    double t, t_naive, t_best = 0, ops = 2.0 * n * n * n;
+    size_t i, bad = 0;
+    int r;
+
+    /* integer valued, so both orders of the sums give the same floats */
+    Fill_i32(w, n * n, density);
+    for (i = 0; i < n * n; i++)
+        a[i] = (w[i] == MINPLUS_INF_I32) ? MINPLUS_INF_F32 : (float)w[i];
+    Fill_i32(w, n * n, density);
+    for (i = 0; i < n * n; i++)
+        b[i] = (w[i] == MINPLUS_INF_I32) ? MINPLUS_INF_F32 : (float)w[i];
+    Fill_i32(w, n * n, density);
+    for (i = 0; i < n * n; i++)
+        c0[i] = (w[i] == MINPLUS_INF_I32) ? MINPLUS_INF_F32 : (float)w[i];
+
+    memcpy(c_naive, c0, n * n * sizeof(float));
+    t = Now();
+    Minplus_naive_f32(n, n, n, a, n, b, n, c_naive, n);
+    t_naive = Now() - t;
+
+    for (r = 0; r < reps; r++)
+    {
+        memcpy(c, c0, n * n * sizeof(float));
+        t = Now();
+        Minplus_gemm_f32(n, n, n, a, n, b, n, c, n);
+        t = Now() - t;
+        if (r == 0 || t < t_best)
+            t_best = t;
+    }
+    for (i = 0; i < n * n; i++)
+        bad += (c[i] != c_naive[i]);
+
+    printf("float: naive %.3f s %.2f GOP/s, blocked %.3f s %.2f GOP/s, speedup %.1f, %s\n",
+           t_naive, ops / t_naive * 1e-9, t_best, ops / t_best * 1e-9, t_naive / t_best,
+           bad ? "MISMATCH" : "ok");
+    free(w);
+    free(a);
+    free(b);
+    free(c0);
+    free(c_naive);
+    free(c);
+}